@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace hl {
+/**\brief monotonic buffer for short living allocations of one request.
+ *
+ * Memory is taken from big blocks and is not freed separately, all
+ * allocations are freed at once by reset. One block is kept between requests,
+ * and after a request, which needed several blocks, the kept block is grown
+ * to their summary size, so in steady state requests don't allocate memory
+ * from heap at all. Not thread safe, every thread has own arena
+ */
+class arena {
+public:
+  explicit arena(size_t block_size) noexcept;
+  ~arena();
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  /**\throw std::bad_alloc
+   */
+  void *allocate(size_t size, size_t alignment);
+
+  /**\brief free all allocations
+   */
+  void reset() noexcept;
+
+  /**\return count of allocations since reset
+   */
+  size_t allocations() const noexcept;
+
+  /**\return allocated bytes since reset
+   */
+  size_t used() const noexcept;
+
+  /**\return count of blocks, allocated from heap since reset
+   */
+  size_t blocks() const noexcept;
+
+  /**\return arena of current thread, set by arena_scope, or null
+   */
+  static arena *current() noexcept;
+
+private:
+  friend class arena_scope;
+
+  struct block {
+    block *next;
+    size_t size;
+  };
+
+  void grow(size_t min_size);
+
+  block *head_; // the newest block
+  char * cur_;
+  char * end_;
+  size_t block_size_; // of the next block
+  size_t allocations_;
+  size_t used_;
+  size_t blocks_;
+
+  static thread_local arena *current_;
+};
+
+/**\brief makes the arena current for the thread while the scope exists, and
+ * resets it at the end. All containers with arena_allocator, created in the
+ * scope, must be destroyed before the end of the scope
+ */
+class arena_scope {
+public:
+  explicit arena_scope(arena &scope_arena) noexcept;
+  ~arena_scope();
+
+  arena_scope(const arena_scope &) = delete;
+  arena_scope &operator=(const arena_scope &) = delete;
+
+private:
+  arena *arena_;
+  arena *previous_;
+};
+
+/**\brief allocator for standard containers, which takes memory from the
+ * current arena of the thread. Without current arena memory is taken from
+ * heap
+ */
+template <typename T>
+class arena_allocator {
+public:
+  using value_type = T;
+
+  arena_allocator() noexcept
+      : arena_{arena::current()} {
+  }
+
+  template <typename U>
+  arena_allocator(const arena_allocator<U> &other) noexcept
+      : arena_{other.arena_} {
+  }
+
+  T *allocate(size_t count) {
+    if (arena_ == nullptr) {
+      return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    return static_cast<T *>(arena_->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *ptr, size_t) noexcept {
+    // memory of arena is freed by reset
+    if (arena_ == nullptr) {
+      ::operator delete(ptr);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const arena_allocator<U> &other) const noexcept {
+    return arena_ == other.arena_;
+  }
+
+  template <typename U>
+  bool operator!=(const arena_allocator<U> &other) const noexcept {
+    return arena_ != other.arena_;
+  }
+
+private:
+  template <typename U>
+  friend class arena_allocator;
+
+  arena *arena_;
+};
+
+using arena_string =
+    std::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+
+template <typename T>
+using arena_list = std::list<T, arena_allocator<T>>;
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+} // namespace hl
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "c_logs/log.h"
+#include <cstddef>
+#include <cstdint>
+
+/**\brief log by the background thread, if asynchronous logging is started,
+ * otherwise by the sync_log macro. Should be used on the request path instead
+ * of LOG_* macros
+ */
+#define ASYNC_LOG(level, sync_log, ...)                                        \
+  {                                                                            \
+    if (hl::async_log::enabled()) {                                            \
+      hl::async_log::push(level, __VA_ARGS__);                                 \
+    } else {                                                                   \
+      sync_log(__VA_ARGS__)                                                    \
+    }                                                                          \
+  }
+
+#define ALOG_WARNING(...) ASYNC_LOG(LogWarning, LOG_WARNING, __VA_ARGS__)
+#define ALOG_INFO(...)    ASYNC_LOG(LogInfo, LOG_INFO, __VA_ARGS__)
+#define ALOG_DEBUG(...)   ASYNC_LOG(LogDebug, LOG_DEBUG, __VA_ARGS__)
+
+namespace hl {
+/**\brief asynchronous logging: records are formatted by the caller to lock-free
+ * ring buffer and written to c_logs sinks by the background thread, so slow
+ * sinks (terminal, journald) don't block the caller. If the ring buffer is
+ * full, records are dropped and counted.
+ *
+ * Records with the same format are rate limited: not more then `rate_limit`
+ * per second, count of suppressed records is logged later
+ */
+namespace async_log {
+/**\param capacity count of records in ring buffer
+ * \param rate_limit max count of records with the same format per second, 0 -
+ * no limit
+ * \return false if logging thread can't be started
+ */
+bool start(size_t capacity, unsigned int rate_limit);
+
+/**\brief write all queued records and stop the logging thread
+ */
+void stop();
+
+/**\brief switch to synchronous logging in forked process, where the logging
+ * thread doesn't exist
+ */
+void reset_after_fork() noexcept;
+
+/**\brief set mask of levels, which are logged. Can be changed at any time
+ */
+void set_levels(int levels) noexcept;
+
+bool enabled() noexcept;
+
+/**\brief format record and queue it for writing
+ */
+void push(int level, const char *format, ...) noexcept
+    __attribute__((format(printf, 2, 3)));
+
+uint64_t dropped() noexcept;
+} // namespace async_log
+} // namespace hl
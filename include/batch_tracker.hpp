@@ -0,0 +1,101 @@
+#pragma once
+
+#include "request_head.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace hl {
+/**\brief splits batch requests to requests for every buffer and collects
+ * their results.
+ *
+ * Items of batch are given to scheduler by parts, not more then `window` items
+ * of one batch are queued or started at the same time, so a batch with
+ * thousands of buffers doesn't overflow queue of the client. Every item is
+ * answered by usual response with message number of the batch, and after the
+ * last item the client gets summary response. Used only by the io thread
+ */
+class batch_tracker {
+public:
+  struct summary {
+    uint64_t    client;
+    std::string response;
+  };
+
+  /**\param push queues the item, returns false if it can't be queued now
+   */
+  using push_type = std::function<bool(uint64_t            client,
+                                       const request_head &head,
+                                       std::string         data)>;
+
+  explicit batch_tracker(size_t window);
+
+  /**\brief change count of items of one batch, which can be queued or started
+   */
+  void set_window(size_t window) noexcept;
+
+  /**\brief start handling of batch request (without delimiter)
+   * \return false if the request is not valid batch
+   */
+  bool add(uint64_t            client,
+           const request_head &head,
+           const char *        data,
+           size_t              size,
+           std::string &       err);
+
+  /**\brief queue items of all batches, while they fit to window
+   */
+  void feed(const push_type &push);
+
+  /**\brief remember started item, should be called for all started requests
+   */
+  void started(uint64_t tag, uint64_t client, const request_head &head);
+
+  /**\brief count finished item
+   * \param failed the item got no response or tokenizer crashed
+   */
+  void finished(uint64_t tag, bool failed);
+
+  /**\brief take summaries of batches, which all items are finished
+   */
+  std::list<summary> take_summaries();
+
+  /**\brief drop all batches of the client
+   */
+  void remove_client(uint64_t client);
+
+private:
+  using clock    = std::chrono::steady_clock;
+  using key_type = std::pair<uint64_t, int>; // client, message number
+
+  struct item {
+    std::string buf_name;
+    std::string buf_body;
+    bool        from_disk; // buf_name is path of the file
+  };
+
+  struct batch {
+    request_head      head;
+    std::string       body; // serialized request body without items
+    std::deque<item>  pending;
+    size_t            count;
+    size_t            queued; // queued or started items
+    size_t            failed;
+    clock::time_point received;
+  };
+
+  void finish_if_done(std::map<key_type, batch>::iterator found);
+
+  size_t window_;
+
+  std::map<key_type, batch>              batches_;
+  std::unordered_map<uint64_t, key_type> started_; // by tag
+  std::list<summary>                     summaries_;
+};
+} // namespace hl
@@ -2,11 +2,18 @@
 
 #include "token.hpp"
 #include <string>
+#include <vector>
 
 
 namespace hl {
-hl::token_list clang_tokenize(const char * filename,
-                              int          argc,
-                              const char * argv[],
-                              std::string &err) noexcept;
+/**\param options flags for parsing of translation unit
+ * \param includes can be null, otherwise will contain paths of included not
+ * system headers
+ */
+hl::token_list clang_tokenize(const char *              filename,
+                              int                       argc,
+                              const char *              argv[],
+                              unsigned int              options,
+                              std::vector<std::string> *includes,
+                              std::string &             err) noexcept;
 }
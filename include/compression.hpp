@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+namespace hl {
+/**\brief first byte of compressed frame. Not compressed responses are json
+ * arrays, so they start from `[`
+ */
+#define COMPRESSED_FRAME_MARK 'z'
+
+/**\brief compress response by zlib to frame `z<base64 of zlib stream>`, so
+ * frame still doesn't contain delimiters
+ * \return false if response can't be compressed, then frame is not changed
+ */
+bool compress_frame(const std::string &response, std::string &frame);
+} // namespace hl
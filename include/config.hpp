@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace hl {
+/**\brief settings, which can be changed without restart of the server
+ */
+struct server_config {
+  std::vector<std::string> default_flags;
+  bool                     verbose;
+  int                      max_inflight;
+  int                      max_queued;
+  int                      max_queue_cost;     // Mb
+  int                      compress_threshold; // Kb
+};
+
+/**\brief override settings by values from config file. The file contains json
+ * object with the same keys as command line options, for example
+ * `{"flag": ["-std=c++17"], "max-inflight": 8}`
+ * \return false if the file can't be read or contains invalid values, in this
+ * case config is not changed
+ */
+bool read_config(const char *path, server_config &config, std::string &err);
+} // namespace hl
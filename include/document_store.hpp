@@ -0,0 +1,70 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hl {
+struct text_edit {
+  // start row, start column, end row, end column; as in token locations
+  unsigned int range[4];
+  std::string  text;
+};
+
+/**\brief buffers of clients with versions, so clients can send only edits
+ * instead of complete buffer. Least recently used buffers are removed, if
+ * summary size is greater then limit. Thread safe
+ */
+class document_store {
+public:
+  explicit document_store(size_t max_bytes);
+
+  /**\brief set complete buffer
+   */
+  void update(const std::string &client,
+              const std::string &buf_name,
+              long long          version,
+              const std::string &body);
+
+  /**\brief apply edits (one by one) to buffer with base_version
+   * \param body will contain updated buffer
+   * \return false if buffer is unknown, has other version or edits are not
+   * valid. In this case buffer is removed, so client must resend complete
+   * buffer
+   */
+  bool apply(const std::string &           client,
+             const std::string &           buf_name,
+             long long                     base_version,
+             long long                     version,
+             const std::vector<text_edit> &edits,
+             std::string &                 body,
+             std::string &                 err);
+
+  /**\brief get kept buffer of the last version
+   * \return false if buffer is unknown
+   */
+  bool get(const std::string &client,
+           const std::string &buf_name,
+           std::string &      body);
+
+private:
+  using key_type = std::pair<std::string, std::string>; // client, buf_name
+
+  struct document {
+    long long                      version;
+    std::string                    body;
+    std::list<key_type>::iterator usage;
+  };
+
+  void shrink();
+
+  size_t                         max_bytes_;
+  size_t                         bytes_;
+  std::map<key_type, document>   documents_;
+  std::list<key_type>            usage_; // most recently used first
+  std::mutex                     mutex_;
+};
+} // namespace hl
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <poll.h>
+#include <string>
+#include <vector>
+
+namespace hl {
+/**\brief executes requests outside of the io loop. Completions are noticed by
+ * polling of executor descriptors together with sockets
+ */
+class executor {
+public:
+  /**\brief sends intermediate response, while handler is still in work
+   */
+  using partial_type = std::function<void(std::string response)>;
+
+  /**\brief files, which final response depends on, and request, which
+   * repeats handling if some of the files is changed
+   */
+  struct dependencies {
+    std::vector<std::string> files;
+    std::string              refresh_request;
+  };
+
+  /**\param deps can be filled by handler
+   * \return final response for the request
+   */
+  using handler_type = std::function<std::string(
+      const char *data, const partial_type &partial, dependencies &deps)>;
+
+  struct completion {
+    uint64_t     tag;
+    bool         lost; // true if request was lost (for example handler crashed)
+    bool         partial; // true for intermediate response, request in work
+    std::string  data;    // response, or original request if lost
+    dependencies deps;    // of final response, can be empty
+  };
+
+  virtual ~executor() = default;
+
+  /**\return false if executor can't handle requests
+   */
+  virtual bool start() = 0;
+
+  /**\return true if request with the route key can be started right now.
+   * Requests which can't be started should wait in scheduler
+   */
+  virtual bool ready(const std::string &route_key) const = 0;
+
+  /**\brief start handling of request (without delimiter). Response will be
+   * returned with the same tag
+   * \return false if request can't be handled
+   */
+  virtual bool
+  send(uint64_t tag, const std::string &route_key, std::string request) = 0;
+
+  /**\brief append descriptors for polling
+   */
+  virtual void add_pollfds(std::vector<pollfd> &pfds) const = 0;
+
+  /**\return count of descriptors, added by add_pollfds
+   */
+  virtual size_t pollfds_count() const noexcept = 0;
+
+  /**\brief handle polled events
+   * \param pfds pointer to first descriptor, added by add_pollfds
+   */
+  virtual std::list<completion> handle_events(const pollfd *pfds) = 0;
+
+  /**\brief notify handlers, that configuration of the server is reloaded
+   */
+  virtual void reload() = 0;
+};
+} // namespace hl
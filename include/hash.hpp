@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hl {
+/**\brief streaming xxHash64
+ */
+class hasher {
+public:
+  explicit hasher(uint64_t seed = 0) noexcept;
+
+  void update(const void *data, size_t size) noexcept;
+  void update(const std::string &str) noexcept;
+
+  uint64_t digest() const noexcept;
+
+private:
+  uint64_t      state_[4];
+  unsigned char buffer_[32];
+  size_t        buffered_;
+  uint64_t      total_;
+  uint64_t      seed_;
+};
+} // namespace hl
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hl {
+/**\brief state of header on disk, which tokens of buffer depend on. Kept
+ * tokens are outdated if some of their headers is changed (also while the
+ * server was stopped)
+ */
+struct header_stamp {
+  std::string path;
+  int64_t     mtime; // ns
+  int64_t     size;
+};
+
+using header_stamps = std::vector<header_stamp>;
+
+/**\param not_after headers modified after this time (for example during
+ * parsing) give false, because tokens can be made from their older version
+ * \return false if some header can't be stat'ed or is modified after
+ * not_after
+ */
+bool make_stamps(const std::vector<std::string> &      headers,
+                 std::chrono::system_clock::time_point not_after,
+                 header_stamps &                       out);
+
+/**\return true if all headers have the same modification time and size
+ */
+bool stamps_valid(const header_stamps &stamps);
+
+/**\brief append stamps in binary form, for persistent records
+ */
+void write_stamps(const header_stamps &stamps, std::string &out);
+
+/**\return false if data is not the same as written by write_stamps
+ */
+bool read_stamps(const char *data, size_t size, header_stamps &out);
+} // namespace hl
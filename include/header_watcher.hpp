@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hl {
+/**\brief watches headers of recently tokenized buffers by inotify.
+ *
+ * Directories of headers are watched instead of files, because headers are
+ * often replaced by renaming (git, code generators). After changing of some
+ * header the buffers, which include it, are reported with their refresh
+ * requests. Changes are reported after short delay, so a lot of changed
+ * headers (for example after `git pull`) gives only one refresh per buffer.
+ *
+ * Only `max_buffers` least recently tokenized buffers are watched. Used only
+ * by the io thread
+ */
+class header_watcher {
+public:
+  struct refresh {
+    uint64_t    client;
+    std::string request;
+  };
+
+  explicit header_watcher(size_t max_buffers);
+  ~header_watcher();
+
+  header_watcher(const header_watcher &) = delete;
+  header_watcher &operator=(const header_watcher &) = delete;
+
+  /**\return false if inotify is not available
+   */
+  bool start();
+
+  /**\return descriptor for polling
+   */
+  int fd() const noexcept;
+
+  /**\brief set headers of buffer, tokenized for the client
+   * \param request will be returned after changing of some header
+   */
+  void watch(uint64_t                        client,
+             const std::string &             buf_name,
+             const std::vector<std::string> &headers,
+             std::string                     request);
+
+  /**\brief stop watching of all buffers of the client
+   */
+  void remove_client(uint64_t client);
+
+  /**\brief read changes of headers, should be called when descriptor is ready
+   */
+  void handle_events();
+
+  /**\brief take refresh requests for buffers, which headers were changed
+   * before the delay
+   */
+  std::list<refresh> take_refreshes();
+
+  /**\return time in ms until the next refresh, or -1 if there are no changes
+   */
+  int timeout_ms() const;
+
+private:
+  using clock    = std::chrono::steady_clock;
+  using key_type = std::pair<uint64_t, std::string>; // client, buf_name
+
+  struct buffer {
+    std::vector<std::string>      headers; // as reported by tokenizer
+    std::vector<std::string>      paths;   // watched real paths
+    std::string                   request;
+    std::list<key_type>::iterator usage;
+  };
+
+  struct directory {
+    int    wd;
+    size_t files; // count of watched files in the directory
+  };
+
+  void add_path(const key_type &key, const std::string &path);
+  void remove_path(const key_type &key, const std::string &path);
+  void remove_buffer(std::map<key_type, buffer>::iterator found);
+
+  /**\brief forget directory, which watch is removed by system, and its files.
+   * Buffers with the files are refreshed and watch them again
+   */
+  void forget_directory(std::string dir_path, clock::time_point now);
+
+  size_t max_buffers_;
+  int    fd_;
+
+  std::map<key_type, buffer>                          buffers_;
+  std::list<key_type>                                 usage_;   // newest first
+  std::unordered_map<std::string, std::set<key_type>> files_;   // by path
+  std::unordered_map<std::string, directory>          dirs_;    // by path
+  std::unordered_map<int, std::string>                watches_; // wd -> dir
+  std::map<key_type, clock::time_point>               changed_;
+};
+} // namespace hl
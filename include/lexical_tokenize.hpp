@@ -0,0 +1,12 @@
+#pragma once
+
+#include "token.hpp"
+#include <cstddef>
+
+namespace hl {
+/**\brief fast c/cpp tokenization without libclang. Uses only lexical rules
+ * and heuristics by position of identifiers, so results are less exact then
+ * results of clang_tokenize. Groups are named like in clang_tokenize
+ */
+hl::token_list lexical_tokenize(const char *data, size_t size);
+} // namespace hl
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hl {
+/**\brief named set of libclang parsing options
+ */
+struct parse_profile {
+  std::string  name;
+  unsigned int options;   // CXTranslationUnit_Flags
+  std::string  downgrade; // profile for big or slow buffers, empty if no
+};
+
+/**\brief selects parse profile for buffer by name from request or by glob of
+ * buffer name. Big buffers, and buffers which were parsed too long, use
+ * downgrade profile, if profile is not requested. Thread safe
+ *
+ * Builtin profiles are `full` (default), `fast` and `minimal`
+ */
+class parse_profiles {
+public:
+  /**\param max_size bigger buffers are downgraded, 0 - no limit
+   * \param max_parse_ms slower buffers are downgraded, 0 - no limit
+   */
+  parse_profiles(size_t max_size, unsigned int max_parse_ms);
+
+  /**\brief add or replace profile by spec `NAME:OPTION,OPTION,...`
+   * \return false if spec is invalid
+   */
+  bool add_profile(const std::string &spec, std::string &err);
+
+  /**\brief buffers matched by glob use the profile, spec `GLOB:NAME`. Globs
+   * are checked in order of adding
+   * \return false if spec is invalid
+   */
+  bool add_glob(const std::string &spec, std::string &err);
+
+  /**\param requested profile name from request, can be empty. Known
+   * requested profile is used as is, without downgrading
+   */
+  parse_profile select(const std::string &requested,
+                       const std::string &buf_name,
+                       size_t             size) const;
+
+  /**\brief remember parse time, so next time slow buffer will be downgraded
+   */
+  void report(const parse_profile &profile,
+              const std::string &  buf_name,
+              unsigned int         parse_ms);
+
+private:
+  const parse_profile *find(const std::string &name) const noexcept;
+
+  size_t       max_size_;
+  unsigned int max_parse_ms_;
+
+  std::vector<parse_profile>                       profiles_;
+  std::vector<std::pair<std::string, std::string>> globs_; // glob, profile
+  std::map<std::string, std::string> slow_; // buf_name, downgraded profile
+  mutable std::mutex                 mutex_;
+};
+} // namespace hl
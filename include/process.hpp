@@ -0,0 +1,54 @@
+#pragma once
+
+#include "document_store.hpp"
+#include "executor.hpp"
+#include "parse_profile.hpp"
+#include "request_head.hpp"
+#include "response_cache.hpp"
+#include "token_store.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hl {
+/**\brief settings, which can be replaced by reloading of config
+ */
+struct process_settings {
+  std::vector<std::string> default_flags;
+  size_t                   compress_threshold; // 0 - don't compress responses
+};
+
+struct process_context {
+  // XXX use std::atomic_load/std::atomic_store for access
+  std::shared_ptr<const process_settings> settings;
+
+  document_store *documents; // can be null, then edits are not supported
+  response_cache *cache;     // can be null
+  token_store *   store;     // can be null
+  parse_profiles *profiles;  // can be null, then buffers are parsed fully
+  bool            watch_headers; // report headers of tokenized buffers
+  const char *    server_version;
+  std::string     allowed_dir; // real path, empty - files are not read
+};
+
+/**\brief handle one request (without delimiter)
+ * \param partial gets intermediate responses for progressive requests, can be
+ * empty
+ * \param deps will contain headers of tokenized buffer and request for its
+ * refresh, if context.watch_headers is set
+ * \return serialized response, or empty string if request can't be decoded or
+ * buffer for refresh is not kept anymore
+ */
+std::string process(const char *                            data,
+                    process_context &                       context,
+                    const std::function<void(std::string)> &partial,
+                    executor::dependencies &                deps);
+
+/**\return serialized response without tokens for request, which can't be
+ * handled
+ */
+std::string make_error_response(const request_head &head,
+                                int                 return_code,
+                                const std::string & error_message);
+} // namespace hl
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace hl {
+enum request_priority {
+  PriorityInteractive = 0,
+  PriorityNormal      = 1,
+  PriorityBackground  = 2,
+};
+
+/**\brief fields of request, which are needed before complete request handling
+ * (routing, error responses)
+ */
+struct request_head {
+  int         message_number = -1;
+  std::string version;
+  std::string id;
+  std::string buf_type;
+  std::string buf_name;
+  std::string control; // command for the server instead of tokenization
+
+  request_priority priority    = PriorityNormal;
+  long long        deadline_ms = -1; // after receiving, -1 if not set
+  bool             incremental = false; // contains edits instead of buffer
+  bool             refresh     = false; // repeats handling of kept buffer
+  size_t           flags_count = 0; // compilation flags in additional_info
+  bool             batch       = false; // contains list of buffers
+  bool             batch_item  = false; // set by the server, not peeked
+};
+
+/**\brief extract request head without building json document. Big values
+ * (like `buf_body`) are skipped without copying
+ * \return false if request is not well formed
+ */
+bool peek_request_head(const char *  data,
+                       size_t        size,
+                       request_head &head) noexcept;
+} // namespace hl
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "header_stamp.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace hl {
+/**\brief serialized tokens by hash of everything they depend on (buffer type,
+ * buffer body, flags, server version). Headers can't be hashed, so every entry
+ * has their stamps, which are checked by the caller. Least recently used
+ * entries are removed, if summary size is greater then limit. Thread safe
+ */
+class response_cache {
+public:
+  explicit response_cache(size_t max_bytes);
+
+  /**\brief stamps are not checked, see stamps_valid
+   * \return false if there is no entry for the key
+   */
+  bool get(uint64_t key, std::string &tokens, header_stamps &stamps);
+
+  void
+  put(uint64_t key, const std::string &tokens, const header_stamps &stamps);
+
+  /**\brief remove outdated entry, its last get is counted as miss
+   */
+  void erase(uint64_t key);
+
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+private:
+  struct entry {
+    std::string                   tokens;
+    header_stamps                 stamps;
+    size_t                        size; // of tokens and stamps
+    std::list<uint64_t>::iterator usage;
+  };
+
+  size_t                              max_bytes_;
+  size_t                              bytes_;
+  uint64_t                            hits_;
+  uint64_t                            misses_;
+  std::unordered_map<uint64_t, entry> entries_;
+  std::list<uint64_t>                 usage_; // most recently used first
+  mutable std::mutex                  mutex_;
+};
+} // namespace hl
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "token.hpp"
+#include <string>
+
+namespace hl {
+/**\brief serialize tokens as `tokens` object of v1.1 response, without
+ * building json document. Output is the same as dump of json object with the
+ * tokens
+ */
+void write_tokens(const token_list &tokens, std::string &out);
+
+/**\brief serialize tokens as compact `tokens` object with `data` and
+ * `groups` arrays. `data` contains 4 integers for every token, sorted by
+ * position: difference of row with previous token, column (difference with
+ * previous token on the same row), length and index of group in `groups`
+ */
+void write_delta_tokens(const token_list &tokens, std::string &out);
+
+/**\brief serialize v1.1 response with already serialized tokens. Output is
+ * the same as dump of json response
+ * \param return_code can be not 0 if tokens are only approximate
+ * \param refreshed marks not requested response after changing of headers
+ * \param partial marks lexical response, which is followed by complete one
+ */
+void write_response(int                message_number,
+                    const std::string &version,
+                    const std::string &id,
+                    const std::string &buf_type,
+                    const std::string &buf_name,
+                    int                return_code,
+                    const std::string &error_message,
+                    bool               refreshed,
+                    bool               partial,
+                    const std::string &tokens,
+                    std::string &      out);
+} // namespace hl
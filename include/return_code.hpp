@@ -0,0 +1,22 @@
+#pragma once
+
+namespace hl {
+/**\brief values of `return_code` field in responses
+ */
+enum return_code {
+  Success                = 0,
+  UnsupportedBufferType  = 1,
+  CantOpenTemporaryFile  = 2,
+  CantWriteTemporaryFile = 3,
+  TokenizerError         = 4,
+  CantParseTokenizerData = 5,
+  TokenizerCrashed       = 6,
+  DeadlineExpired        = 7,
+  ResendFullBuffer       = 8,
+  ServerBusy             = 9,
+  ControlFailed          = 10,
+  CantReadBuffer         = 11,
+  InvalidBatch           = 12,
+  Superseded             = 13,
+};
+} // namespace hl
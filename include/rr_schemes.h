@@ -19,7 +19,15 @@ const char *request_schema_v11 = R"(
         "request_body": {
             "type": "object",
             "required": [
-                "version", "id", "buf_type", "buf_name", "buf_body", "additional_info"
+                "version", "id", "buf_type", "buf_name", "additional_info"
+            ],
+            "anyOf": [
+                { "required": ["buf_body"] },
+                { "required": ["edits", "base_version", "buf_version"] },
+                { "required": ["refresh"] },
+                { "required": ["control"] },
+                { "required": ["buf_path"] },
+                { "required": ["batch"] }
             ],
             "properties": {
                 "version": {
@@ -43,9 +51,108 @@ const char *request_schema_v11 = R"(
                     "comment": "complete buffer entity",
                     "type": "string"
                 },
+                "buf_path": {
+                    "comment": "optional, path of file in directory --allow-paths, which is read by the server instead of buf_body",
+                    "type": "string"
+                },
+                "buf_version": {
+                    "comment": "optional, if set the server keeps the buffer for next incremental requests",
+                    "type": "integer"
+                },
+                "base_version": {
+                    "comment": "version of kept buffer, which edits are applied to",
+                    "type": "integer"
+                },
+                "edits": {
+                    "comment": "edits for kept buffer instead of complete buffer entity, applied one by one",
+                    "type": "array",
+                    "items": {
+                        "$ref": "#/definitions/text_edit"
+                    }
+                },
                 "additional_info": {
                     "comment": "some handler specific information",
                     "type": "string"
+                },
+                "priority": {
+                    "comment": "optional, interactive requests are handled first",
+                    "type": "string",
+                    "enum": ["interactive", "normal", "background"]
+                },
+                "deadline_ms": {
+                    "comment": "optional, request is rejected if it is not started during this time after receiving",
+                    "type": "integer",
+                    "minimum": 0
+                },
+                "progressive": {
+                    "comment": "optional, fast lexical response is sent before complete response with the same message number",
+                    "type": "boolean"
+                },
+                "profile": {
+                    "comment": "optional, name of parse profile for c/cpp buffers",
+                    "type": "string"
+                },
+                "compression": {
+                    "comment": "optional, big responses can be sent as compressed frames",
+                    "type": "string",
+                    "enum": ["zlib"]
+                },
+                "encoding": {
+                    "comment": "optional, tokens are sent as flat array of integers with differences of positions",
+                    "type": "string",
+                    "enum": ["delta"]
+                },
+                "refresh": {
+                    "comment": "optional, tokenize kept buffer again, used by the server after changing of headers",
+                    "type": "boolean"
+                },
+                "control": {
+                    "comment": "optional, command for the server instead of tokenization, the response contains only return code",
+                    "type": "string",
+                    "enum": ["reload"]
+                },
+                "batch": {
+                    "comment": "optional, buffers which are tokenized with common fields of the request, every one gets own response, then summary response is sent",
+                    "type": "array",
+                    "items": {
+                        "$ref": "#/definitions/batch_item"
+                    }
+                }
+            },
+            "additionalProperties": false
+        },
+        "batch_item": {
+            "type": "object",
+            "required": ["buf_name"],
+            "properties": {
+                "buf_name": {
+                    "comment": "name of buffer, if buf_body is not set the buffer is read from file with this path",
+                    "type": "string"
+                },
+                "buf_body": {
+                    "comment": "optional, complete buffer entity",
+                    "type": "string"
+                }
+            },
+            "additionalProperties": false
+        },
+        "text_edit": {
+            "type": "object",
+            "required": ["range", "text"],
+            "properties": {
+                "range": {
+                    "comment": "start row, start column, end row, end column",
+                    "type": "array",
+                    "items": {
+                        "type": "integer",
+                        "minimum": 1
+                    },
+                    "minItems": 4,
+                    "maxItems": 4
+                },
+                "text": {
+                    "comment": "replacement for the range",
+                    "type": "string"
                 }
             },
             "additionalProperties": false
@@ -99,9 +206,29 @@ const char *response_schema_v11 = R"(
                     "comment": "contains inforamtion about error (if some error caused) ",
                     "type": "string"
                 },
+                "partial": {
+                    "comment": "optional, set for the first lexical response of progressive request, the complete response with the same message number follows",
+                    "type": "boolean"
+                },
+                "refreshed": {
+                    "comment": "optional, set for not requested response after changing of headers of the buffer",
+                    "type": "boolean"
+                },
+                "batch_summary": {
+                    "comment": "optional, set for the last response for batch request",
+                    "type": "object",
+                    "properties": {
+                        "files": { "type": "integer" },
+                        "failed": { "type": "integer" },
+                        "elapsed_ms": { "type": "integer" }
+                    }
+                },
                 "tokens": {
-                    "comment": "contains dictionary of tokens by token groups",
-                    "$ref": "#/definitions/tokens"
+                    "comment": "contains dictionary of tokens by token groups, or delta encoded tokens if it is requested",
+                    "oneOf": [
+                        { "$ref": "#/definitions/tokens" },
+                        { "$ref": "#/definitions/delta_tokens" }
+                    ]
                 }
             },
             "additionalProperties": false
@@ -115,6 +242,28 @@ const char *response_schema_v11 = R"(
             },
             "additionalProperties": false
         },
+        "delta_tokens": {
+            "type": "object",
+            "required": ["data", "groups"],
+            "properties": {
+                "data": {
+                    "comment": "4 integers for every token sorted by position: difference of row, column (difference on the same row), token_size, index of group",
+                    "type": "array",
+                    "items": {
+                        "type": "integer",
+                        "minimum": 0
+                    }
+                },
+                "groups": {
+                    "comment": "names of token groups",
+                    "type": "array",
+                    "items": {
+                        "type": "string"
+                    }
+                }
+            },
+            "additionalProperties": false
+        },
         "array_of_token_koordinates": {
             "type": "array",
             "items": {
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "request_head.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace hl {
+struct job {
+  using clock = std::chrono::steady_clock;
+
+  uint64_t          client;
+  uint64_t          tag;
+  request_head      head;
+  std::string       data; // request without delimiter
+  clock::time_point received;
+  size_t            cost; // estimated by size of request and count of flags
+};
+
+/**\brief queues requests of clients until they can be started.
+ *
+ * Requests with higher priority are started first. Priority of waiting
+ * request grows with time, so background requests are not starved. Clients
+ * with requests of the same priority are served in round-robin order, so one
+ * client with many requests can't monopolize the server. Every client can't
+ * have more then `max_inflight` started requests at the same time.
+ *
+ * Requests of one client for the same buffer are started one by one, in order
+ * of receiving, because incremental requests depend on previous ones. Not
+ * started request is replaced by newer request with complete buffer for the
+ * same buffer from the same client, replaced requests can be taken for
+ * answering them. Refresh requests don't replace other
+ * requests and are ignored if there is queued request for the same buffer.
+ * Items of batches are never replaced and don't replace other requests. They
+ * are not limited by `max_inflight`, only by `can_start` of the executor
+ *
+ * New requests are rejected, if the client has `max_client_queued` not started
+ * requests, or if summary cost of all not started requests is greater then
+ * `max_queued_cost`. Replacing of not started request is always accepted
+ */
+class scheduler {
+public:
+  /**\param max_client_queued 0 - no limit
+   * \param max_queued_cost 0 - no limit
+   */
+  scheduler(size_t max_inflight,
+            size_t max_client_queued,
+            size_t max_queued_cost);
+
+  /**\param retry_after_ms will be set to estimated time, after that the
+   * request can be accepted
+   * \return false if the request is rejected because of overload
+   */
+  bool push(uint64_t      client,
+            request_head  head,
+            std::string   data,
+            unsigned int &retry_after_ms);
+
+  /**\brief take next request, which can be started
+   * \param can_start checks that executor can start the request right now
+   * \return false if there is no request for start
+   */
+  bool pop(const std::function<bool(const job &)> &can_start, job &out);
+
+  /**\brief take not started request, which deadline is expired
+   * \return false if there is no such request
+   */
+  bool pop_expired(job &out);
+
+  /**\brief mark started request as finished
+   * \param client will be set to client of the request
+   * \return false if the request is unknown
+   */
+  bool finish(uint64_t tag, uint64_t &client);
+
+  /**\brief find client of started request without finishing it
+   * \return false if the request is unknown
+   */
+  bool client_of(uint64_t tag, uint64_t &client) const;
+
+  /**\brief take requests, which were replaced by newer requests since
+   * previous call. Their data is not kept
+   */
+  std::list<job> take_replaced();
+
+  /**\brief remove all not started requests of client
+   */
+  void remove_client(uint64_t client);
+
+  /**\brief change limits, given to constructor. Already queued and started
+   * requests are kept, even if they exceed new limits
+   */
+  void set_limits(size_t max_inflight,
+                  size_t max_client_queued,
+                  size_t max_queued_cost) noexcept;
+
+  size_t   queued() const noexcept;
+  size_t   inflight() const noexcept;
+  uint64_t rejected() const noexcept;
+
+private:
+  struct client_state {
+    std::deque<job>       queue;
+    size_t                inflight = 0; // without items of batches
+    std::set<std::string> started_buffers;
+  };
+
+  struct started_job {
+    uint64_t               client;
+    std::string            buf_name;
+    size_t                 cost;
+    bool                   batch_item;
+    job::clock::time_point started;
+  };
+
+  unsigned int retry_after() const noexcept;
+  void         add_replaced(job replaced);
+
+  size_t   max_inflight_;
+  size_t   max_client_queued_;
+  size_t   max_queued_cost_;
+  uint64_t tag_counter_;
+  uint64_t last_served_;
+  size_t   queued_;
+  size_t   queued_cost_;
+  uint64_t rejected_;
+  double   ms_per_cost_; // average handling time of unit of cost
+
+  std::map<uint64_t, client_state> clients_;
+  std::map<uint64_t, started_job>  started_; // by tag
+  std::list<job>                   replaced_;
+};
+} // namespace hl
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "executor.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace hl {
+/**\brief executes requests by threads of the server process
+ */
+class thread_pool final : public executor {
+public:
+  thread_pool(size_t count, handler_type handler);
+  ~thread_pool() override;
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  bool start() override;
+  bool ready(const std::string &route_key) const override;
+  bool send(uint64_t           tag,
+            const std::string &route_key,
+            std::string        request) override;
+
+  void   add_pollfds(std::vector<pollfd> &pfds) const override;
+  size_t pollfds_count() const noexcept override;
+
+  std::list<completion> handle_events(const pollfd *pfds) override;
+
+  /**\brief does nothing, because threads use settings of the server process
+   */
+  void reload() override;
+
+private:
+  struct task {
+    uint64_t    tag;
+    std::string request;
+  };
+
+  void run();
+
+  size_t       count_;
+  handler_type handler_;
+  int          event_fd_;
+  size_t       busy_; // changed only by io thread
+
+  std::vector<std::thread> threads_;
+  std::mutex               mutex_;
+  std::condition_variable  cv_;
+  std::deque<task>         tasks_;
+  std::list<completion>    completions_;
+  bool                     stop_;
+};
+} // namespace hl
@@ -1,16 +1,17 @@
 #pragma once
 
+#include "arena.hpp"
 #include <array>
-#include <list>
-#include <string>
 
 namespace hl {
 using token_location = std::array<unsigned int, 3>; // row, column, lenght
 
 struct token {
-  std::string    group;
+  arena_string   group;
   token_location pos;
 };
 
-using token_list = std::list<token>;
+/**\brief lives only during handling of request, so it uses arena
+ */
+using token_list = arena_list<token>;
 } // namespace hl
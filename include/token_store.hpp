@@ -0,0 +1,78 @@
+#pragma once
+
+#include "header_stamp.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace hl {
+/**\brief persistent serialized tokens by the same keys as in response_cache.
+ * Every record also has stamps of headers, which the tokens depend on, so
+ * outdated tokens can be detected after restart.
+ *
+ * Records are appended to one file, which is mapped to memory for reading.
+ * Index of records is loaded in background after opening, every record is
+ * checked by checksum, and the file is truncated after the first broken
+ * record (for example, not completely written before crash). Until loading
+ * is finished the store is empty.
+ *
+ * If the file is bigger then limit, it is compacted in background: the most
+ * recently used records are copied to new file, which replaces the old one.
+ * Thread safe, but the file must be used only by one process
+ */
+class token_store {
+public:
+  /**\param max_size size of file for compaction
+   */
+  token_store(std::string path, size_t max_size);
+  ~token_store();
+
+  token_store(const token_store &) = delete;
+  token_store &operator=(const token_store &) = delete;
+
+  /**\brief open the file and start loading of index
+   * \return false if the file can't be opened
+   */
+  bool open();
+
+  /**\brief stamps are not checked, see stamps_valid
+   * \return false if there is no valid record for the key
+   */
+  bool get(uint64_t key, std::string &tokens, header_stamps &stamps);
+
+  void
+  put(uint64_t key, const std::string &tokens, const header_stamps &stamps);
+
+private:
+  struct entry {
+    uint64_t offset; // of record header
+    uint32_t size;   // of tokens
+    uint64_t used;   // last usage, for compaction
+  };
+
+  using index_type = std::unordered_map<uint64_t, entry>;
+
+  void load();
+  void compact();
+  bool remap(size_t size);
+
+  std::string path_;
+  size_t      max_size_;
+
+  int    fd_;
+  char * data_;   // mapped memory
+  size_t mapped_; // size of mapped memory
+  size_t size_;   // size of file
+
+  index_type        index_;
+  uint64_t          use_counter_;
+  std::atomic<bool> loaded_;
+  bool              compacting_;
+  std::thread       loader_;
+  std::thread       compactor_;
+  std::mutex        mutex_;
+};
+} // namespace hl
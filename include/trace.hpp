@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hl {
+/**\brief tracing of requests in Chrome trace-event format, which can be
+ * opened by Perfetto or chrome://tracing.
+ *
+ * Every phase of sampled request is recorded as complete event with tags of
+ * the request. Events are formatted by the caller and written to the file by
+ * the background thread. The server process and workers append to the same
+ * file, closing bracket of json array is written at stop (it is optional for
+ * trace viewers, so the file can be opened while the server works)
+ */
+namespace trace {
+using clock = std::chrono::steady_clock;
+
+struct tags {
+  uint64_t    connection; // 0 if unknown, for example in workers
+  std::string id;         // client id
+  std::string buf_name;
+  int         message_number;
+  size_t      size;   // of buffer or request
+  size_t      tokens; // 0 if unknown
+};
+
+/**\param sample_rate one of `sample_rate` requests is traced
+ * \return false if the file can't be opened
+ */
+bool start(const char *path, unsigned int sample_rate);
+
+/**\brief write all recorded events and close the file
+ */
+void stop();
+
+/**\brief start own writing thread in forked worker, events are appended to
+ * the same file
+ */
+void reset_after_fork();
+
+bool enabled() noexcept;
+
+/**\return true if the request must be traced. All processes give the same
+ * result for the same request
+ */
+bool sampled(const std::string &id, int message_number) noexcept;
+
+/**\brief record complete event, if tracing is started
+ */
+void complete(const char *      name,
+              clock::time_point begin,
+              clock::time_point end,
+              const tags &      request_tags) noexcept;
+
+/**\brief record phase of request of the current thread from begin till now.
+ * Does nothing outside of request_scope or if the request is not sampled
+ */
+void phase(const char *name, clock::time_point begin) noexcept;
+
+/**\brief request, handled by the current thread. At the end whole handling is
+ * recorded as `process` event
+ */
+class request_scope {
+public:
+  request_scope() noexcept;
+  ~request_scope();
+
+  request_scope(const request_scope &) = delete;
+  request_scope &operator=(const request_scope &) = delete;
+
+  /**\brief set tags of decoded request and decide, if it is traced
+   */
+  void begin(tags request_tags);
+
+  void set_size(size_t size) noexcept;
+  void set_tokens(size_t count) noexcept;
+
+private:
+  friend void phase(const char *name, clock::time_point begin) noexcept;
+
+  clock::time_point start_;
+  tags              tags_;
+  bool              sampled_;
+  request_scope *   previous_;
+};
+} // namespace trace
+} // namespace hl
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "executor.hpp"
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace hl {
+/**\brief supervisor side of forked tokenizer processes.
+ *
+ * Every request is routed to a worker by consistent hash of its route key
+ * (buffer name), so warm state of one buffer always lives in one process.
+ * Workers handle requests one by one, so if a worker crashes only the request
+ * which was in work is lost, other queued requests are resent to the
+ * restarted worker
+ */
+class worker_pool final : public executor {
+public:
+  /**\param handler called in worker process for every request
+   * \param on_fork called in worker process right after fork with index of
+   * the worker, must close all descriptors inherited from supervisor
+   * (listener, client sockets)
+   */
+  worker_pool(size_t                      count,
+              handler_type                handler,
+              std::function<void(size_t)> on_fork);
+  ~worker_pool() override;
+
+  worker_pool(const worker_pool &) = delete;
+  worker_pool &operator=(const worker_pool &) = delete;
+
+  /**\brief fork all workers
+   * \return false if no one worker can be started
+   */
+  bool start() override;
+
+  /**\return true if worker, selected by route_key, has free place in its
+   * queue
+   */
+  bool ready(const std::string &route_key) const override;
+
+  /**\brief queue request for worker, selected by route_key
+   * \return false if selected worker is not available
+   */
+  bool send(uint64_t           tag,
+            const std::string &route_key,
+            std::string        request) override;
+
+  void   add_pollfds(std::vector<pollfd> &pfds) const override;
+  size_t pollfds_count() const noexcept override;
+
+  std::list<completion> handle_events(const pollfd *pfds) override;
+
+  /**\brief send SIGHUP to all workers, so they reload configuration before
+   * the next request
+   */
+  void reload() override;
+
+private:
+  struct pending {
+    uint64_t    tag;
+    std::string request;
+  };
+
+  struct worker {
+    pid_t              pid;
+    int                fd;
+    std::string        input;
+    std::string        output;
+    size_t             output_offset;
+    std::list<pending> inflight;
+    dependencies       deps; // of the first inflight request
+  };
+
+  bool   spawn(size_t index);
+  void   reap(size_t index, std::list<completion> &completions);
+  void   flush(worker &w);
+  size_t route(const std::string &route_key) const noexcept;
+
+  handler_type                handler_;
+  std::function<void(size_t)> on_fork_;
+  std::vector<worker>         workers_;
+
+  // consistent hash ring: hash of virtual node -> worker index
+  std::vector<std::pair<uint64_t, size_t>> ring_;
+};
+} // namespace hl
@@ -0,0 +1,117 @@
+#include "arena.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#define MAX_KEPT_SIZE 16 * 1024 * 1024 // 16Mb, bigger blocks are freed
+
+namespace hl {
+thread_local arena *arena::current_ = nullptr;
+
+arena::arena(size_t block_size) noexcept
+    : head_{nullptr}
+    , cur_{nullptr}
+    , end_{nullptr}
+    , block_size_{block_size}
+    , allocations_{0}
+    , used_{0}
+    , blocks_{0} {
+}
+
+arena::~arena() {
+  while (head_ != nullptr) {
+    block *next = head_->next;
+    ::operator delete(head_);
+    head_ = next;
+  }
+}
+
+void *arena::allocate(size_t size, size_t alignment) {
+  size_t padding = -reinterpret_cast<uintptr_t>(cur_) & (alignment - 1);
+  if (cur_ == nullptr || size + padding > size_t(end_ - cur_)) {
+    this->grow(size + alignment);
+    padding = -reinterpret_cast<uintptr_t>(cur_) & (alignment - 1);
+  }
+
+  char *retval = cur_ + padding;
+  cur_         = retval + size;
+  ++allocations_;
+  used_ += size;
+  return retval;
+}
+
+void arena::reset() noexcept {
+  size_t total = 0;
+  for (block *cur = head_; cur != nullptr; cur = cur->next) {
+    total += cur->size;
+  }
+
+  // several blocks are replaced by one block with summary size
+  if (head_ != nullptr &&
+      (head_->next != nullptr || head_->size > MAX_KEPT_SIZE)) {
+    while (head_ != nullptr) {
+      block *next = head_->next;
+      ::operator delete(head_);
+      head_ = next;
+    }
+    cur_        = nullptr;
+    end_        = nullptr;
+    block_size_ = std::min<size_t>(total, MAX_KEPT_SIZE);
+  } else if (head_ != nullptr) {
+    cur_ = reinterpret_cast<char *>(head_) + sizeof(block);
+  }
+
+  allocations_ = 0;
+  used_        = 0;
+  blocks_      = 0;
+}
+
+size_t arena::allocations() const noexcept {
+  return allocations_;
+}
+
+size_t arena::used() const noexcept {
+  return used_;
+}
+
+size_t arena::blocks() const noexcept {
+  return blocks_;
+}
+
+arena *arena::current() noexcept {
+  return current_;
+}
+
+void arena::grow(size_t min_size) {
+  size_t size  = std::max(block_size_, min_size + sizeof(block));
+  block *added = static_cast<block *>(::operator new(size));
+  added->next  = head_;
+  added->size  = size;
+  head_        = added;
+  cur_         = reinterpret_cast<char *>(added) + sizeof(block);
+  end_         = reinterpret_cast<char *>(added) + size;
+  ++blocks_;
+
+  // big requests don't take a lot of small blocks
+  block_size_ = std::min<size_t>(block_size_ * 2, MAX_KEPT_SIZE);
+}
+
+
+arena_scope::arena_scope(arena &scope_arena) noexcept
+    : arena_{&scope_arena}
+    , previous_{arena::current_} {
+  arena::current_ = arena_;
+}
+
+arena_scope::~arena_scope() {
+  ALOG_DEBUG("arena: %zu allocations, %.1fKb, %zu blocks from heap",
+             arena_->allocations(),
+             arena_->used() / 1024.,
+             arena_->blocks());
+
+  arena::current_ = previous_;
+  arena_->reset();
+}
+} // namespace hl
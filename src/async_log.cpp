@@ -0,0 +1,242 @@
+#include "async_log.hpp"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <thread>
+
+#define RECORD_SIZE    256 // bytes of formatted record, longer are truncated
+#define LIMITERS_COUNT 256 // formats, which are rate limited at the same time
+#define DRAIN_SLEEP_MS 10  // if there are no records
+
+namespace {
+struct record {
+  std::atomic<size_t> sequence;
+  int                 level;
+  char                text[RECORD_SIZE];
+};
+
+struct limiter {
+  std::atomic<const char *> format;
+  std::atomic<long long>    second; // of current window
+  std::atomic<unsigned int> count;  // in current window
+  std::atomic<unsigned int> suppressed;
+};
+} // namespace
+
+// XXX ring buffer is bounded multi producer single consumer queue: producer
+// takes position by incrementing of `tail`, and publishes the record by
+// sequence of the slot
+static std::unique_ptr<record[]> records;
+static size_t                    mask = 0;
+static std::atomic<size_t>       tail{0};
+static size_t                    head = 0; // changed only by logging thread
+
+static std::atomic<bool>     started{false};
+static std::atomic<bool>     stopping{false};
+static std::atomic<uint64_t> dropped_count{0};
+static std::thread           drainer;
+
+static std::atomic<int> log_levels{0};
+static unsigned int     log_rate = 0;
+static limiter          limiters[LIMITERS_COUNT];
+
+static bool allow(const char *format) noexcept;
+static void put(int level, const char *format, va_list args) noexcept;
+static void put_summary(int level, const char *format, ...) noexcept;
+static void write_record(int level, const char *text) noexcept;
+static void drain() noexcept;
+
+namespace hl {
+namespace async_log {
+bool start(size_t capacity, unsigned int rate_limit) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  records.reset(new record[size]);
+  for (size_t i = 0; i < size; ++i) {
+    records[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask     = size - 1;
+  log_rate = rate_limit;
+
+  try {
+    drainer = std::thread(drain);
+  } catch (std::exception &e) {
+    LOG_ERROR("can't start logging thread: %s", e.what());
+    records.reset();
+    return false;
+  }
+
+  started = true;
+  return true;
+}
+
+void stop() {
+  if (started == false) {
+    return;
+  }
+
+  // records after stop are written synchronously
+  started  = false;
+  stopping = true;
+  drainer.join();
+
+  if (dropped_count != 0) {
+    LOG_WARNING("dropped log records: %" PRIu64, dropped_count.load());
+  }
+}
+
+void reset_after_fork() noexcept {
+  started = false;
+}
+
+void set_levels(int levels) noexcept {
+  log_levels.store(levels, std::memory_order_relaxed);
+}
+
+bool enabled() noexcept {
+  return started.load(std::memory_order_relaxed);
+}
+
+void push(int level, const char *format, ...) noexcept {
+  if ((level & log_levels.load(std::memory_order_relaxed)) == 0 ||
+      allow(format) == false) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  put(level, format, args);
+  va_end(args);
+}
+
+uint64_t dropped() noexcept {
+  return dropped_count;
+}
+} // namespace async_log
+} // namespace hl
+
+
+static void put(int level, const char *format, va_list args) noexcept {
+  size_t  pos  = tail.load(std::memory_order_relaxed);
+  record *slot = nullptr;
+  for (;;) {
+    slot            = &records[pos & mask];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence == pos) {
+      if (tail.compare_exchange_weak(pos,
+                                     pos + 1,
+                                     std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < pos) {
+      // logging thread is behind, so don't wait it
+      ++dropped_count;
+      return;
+    } else {
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  vsnprintf(slot->text, sizeof(slot->text), format, args);
+
+  slot->level = level;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+static bool allow(const char *format) noexcept {
+  if (log_rate == 0) {
+    return true;
+  }
+
+  size_t   index = (reinterpret_cast<uintptr_t>(format) >> 3) % LIMITERS_COUNT;
+  limiter &lim   = limiters[index];
+
+  const char *expected = nullptr;
+  if (lim.format.compare_exchange_strong(expected, format) == false &&
+      expected != format) {
+    // the slot is used by other format, so the format is not limited
+    return true;
+  }
+
+  long long now = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+  long long second = lim.second.load(std::memory_order_relaxed);
+  if (second != now &&
+      lim.second.compare_exchange_strong(second, now) == true) {
+    lim.count               = 0;
+    unsigned int suppressed = lim.suppressed.exchange(0);
+    if (suppressed != 0) {
+      put_summary(LogWarning,
+                  "suppressed %u similar log records: %s",
+                  suppressed,
+                  format);
+    }
+  }
+
+  if (lim.count.fetch_add(1) < log_rate) {
+    return true;
+  }
+
+  ++lim.suppressed;
+  return false;
+}
+
+static void put_summary(int level, const char *format, ...) noexcept {
+  va_list args;
+  va_start(args, format);
+  put(level, format, args);
+  va_end(args);
+}
+
+static void write_record(int level, const char *text) noexcept {
+  switch (level) {
+  case LogWarning:
+    LOG_WARNING("%s", text);
+    break;
+  case LogInfo:
+    LOG_INFO("%s", text);
+    break;
+  case LogDebug:
+    LOG_DEBUG("%s", text);
+    break;
+  default:
+    LOG_ERROR("%s", text);
+    break;
+  }
+}
+
+static void drain() noexcept {
+  uint64_t reported = 0;
+
+  for (;;) {
+    record &slot     = records[head & mask];
+    size_t  sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == head + 1) {
+      write_record(slot.level, slot.text);
+      slot.sequence.store(head + mask + 1, std::memory_order_release);
+      ++head;
+      continue;
+    }
+
+    // all records before stop are written
+    if (stopping) {
+      return;
+    }
+
+    uint64_t dropped = dropped_count;
+    if (dropped != reported) {
+      LOG_WARNING("dropped log records: %" PRIu64, dropped);
+      reported = dropped;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{DRAIN_SLEEP_MS});
+  }
+}
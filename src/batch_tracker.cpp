@@ -0,0 +1,216 @@
+#include "batch_tracker.hpp"
+#include "async_log.hpp"
+#include "return_code.hpp"
+#include <climits>
+#include <exception>
+#include <nlohmann/json.hpp>
+
+#define VERSION_TAG       "version"
+#define ID_TAG            "id"
+#define BUF_TYPE_TAG      "buf_type"
+#define BUF_NAME_TAG      "buf_name"
+#define BUF_BODY_TAG      "buf_body"
+#define BUF_PATH_TAG      "buf_path"
+#define BUF_VERSION_TAG   "buf_version"
+#define BASE_VERSION_TAG  "base_version"
+#define EDITS_TAG         "edits"
+#define REFRESH_TAG       "refresh"
+#define CONTROL_TAG       "control"
+#define DEADLINE_TAG      "deadline_ms"
+#define BATCH_TAG         "batch"
+#define RETURN_CODE_TAG   "return_code"
+#define ERROR_MESSAGE_TAG "error_message"
+#define TOKENS_TAG        "tokens"
+#define SUMMARY_TAG       "batch_summary"
+#define FILES_TAG         "files"
+#define FAILED_TAG        "failed"
+#define ELAPSED_TAG       "elapsed_ms"
+
+namespace hl {
+batch_tracker::batch_tracker(size_t window)
+    : window_{window} {
+}
+
+void batch_tracker::set_window(size_t window) noexcept {
+  window_ = window;
+}
+
+bool batch_tracker::add(uint64_t            client,
+                        const request_head &head,
+                        const char *        data,
+                        size_t              size,
+                        std::string &       err) {
+  using nlohmann::json;
+
+  key_type key{client, head.message_number};
+  if (batches_.count(key) != 0) {
+    err = "batch with the same message number is in work";
+    return false;
+  }
+
+  batch new_batch{head, "", {}, 0, 0, 0, clock::now()};
+  try {
+    json  jrequest = json::parse(data, data + size);
+    json &jbody    = jrequest.at(1);
+    json  jitems   = std::move(jbody.at(BATCH_TAG));
+    if (jitems.is_array() == false) {
+      err = "batch must be array";
+      return false;
+    }
+
+    for (json &jitem : jitems) {
+      item new_item{jitem.at(BUF_NAME_TAG).get<std::string>(), "", true};
+
+      json::iterator found = jitem.find(BUF_BODY_TAG);
+      if (found != jitem.end()) {
+        new_item.buf_body  = std::move(found->get_ref<std::string &>());
+        new_item.from_disk = false;
+      }
+      new_batch.pending.emplace_back(std::move(new_item));
+    }
+
+    // the rest of the body is common for all items
+    for (const char *tag : {BATCH_TAG,
+                            BUF_NAME_TAG,
+                            BUF_BODY_TAG,
+                            BUF_PATH_TAG,
+                            BUF_VERSION_TAG,
+                            BASE_VERSION_TAG,
+                            EDITS_TAG,
+                            REFRESH_TAG,
+                            CONTROL_TAG,
+                            DEADLINE_TAG}) {
+      jbody.erase(tag);
+    }
+    if (jbody.empty()) {
+      err = "batch request without common fields";
+      return false;
+    }
+
+    // XXX fields of item are appended to the body, so closing bracket is
+    // removed
+    new_batch.body = jbody.dump();
+    new_batch.body.pop_back();
+  } catch (std::exception &e) {
+    err = e.what();
+    return false;
+  }
+
+  new_batch.head.batch       = false;
+  new_batch.head.batch_item  = true;
+  new_batch.head.deadline_ms = -1;
+  new_batch.count            = new_batch.pending.size();
+
+  ALOG_DEBUG("batch %d of %zu buffers", head.message_number, new_batch.count);
+
+  this->finish_if_done(batches_.emplace(key, std::move(new_batch)).first);
+  return true;
+}
+
+void batch_tracker::feed(const push_type &push) {
+  using nlohmann::json;
+
+  for (auto &entry : batches_) {
+    batch &cur = entry.second;
+    while (cur.pending.empty() == false && cur.queued < window_) {
+      const item &next = cur.pending.front();
+
+      std::string request = '[' + std::to_string(entry.first.second) + ',';
+      request += cur.body;
+      request += ",\"" BUF_NAME_TAG "\":";
+      request += json(next.buf_name).dump();
+      if (next.from_disk) {
+        request += ",\"" BUF_PATH_TAG "\":";
+        request += json(next.buf_name).dump();
+      } else {
+        request += ",\"" BUF_BODY_TAG "\":";
+        request += json(next.buf_body).dump();
+      }
+      request += "}]";
+
+      request_head head = cur.head;
+      head.buf_name     = next.buf_name;
+      if (push(entry.first.first, head, std::move(request)) == false) {
+        break;
+      }
+
+      cur.pending.pop_front();
+      ++cur.queued;
+    }
+  }
+}
+
+void batch_tracker::started(uint64_t            tag,
+                            uint64_t            client,
+                            const request_head &head) {
+  key_type key{client, head.message_number};
+  if (batches_.count(key) != 0) {
+    started_[tag] = key;
+  }
+}
+
+void batch_tracker::finished(uint64_t tag, bool failed) {
+  auto key = started_.find(tag);
+  if (key == started_.end()) {
+    return;
+  }
+
+  auto found = batches_.find(key->second);
+  started_.erase(key);
+  if (found == batches_.end()) {
+    return;
+  }
+
+  --found->second.queued;
+  if (failed) {
+    ++found->second.failed;
+  }
+  this->finish_if_done(found);
+}
+
+std::list<batch_tracker::summary> batch_tracker::take_summaries() {
+  std::list<summary> retval;
+  retval.swap(summaries_);
+  return retval;
+}
+
+void batch_tracker::remove_client(uint64_t client) {
+  batches_.erase(batches_.lower_bound(key_type{client, INT_MIN}),
+                 batches_.upper_bound(key_type{client, INT_MAX}));
+}
+
+void batch_tracker::finish_if_done(std::map<key_type, batch>::iterator found) {
+  using nlohmann::json;
+
+  const batch &cur = found->second;
+  if (cur.pending.empty() == false || cur.queued != 0) {
+    return;
+  }
+
+  long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          clock::now() - cur.received)
+                          .count();
+
+  ALOG_DEBUG("batch %d finished: %zu buffers, %zu failed, %lld ms",
+             found->first.second,
+             cur.count,
+             cur.failed,
+             elapsed);
+
+  json jresponse;
+  jresponse[0]                    = found->first.second;
+  jresponse[1][VERSION_TAG]       = cur.head.version;
+  jresponse[1][ID_TAG]            = cur.head.id;
+  jresponse[1][BUF_TYPE_TAG]      = cur.head.buf_type;
+  jresponse[1][BUF_NAME_TAG]      = "";
+  jresponse[1][RETURN_CODE_TAG]   = Success;
+  jresponse[1][ERROR_MESSAGE_TAG] = "";
+  jresponse[1][TOKENS_TAG]        = json::object();
+  jresponse[1][SUMMARY_TAG]       = {{FILES_TAG, cur.count},
+                               {FAILED_TAG, cur.failed},
+                               {ELAPSED_TAG, elapsed}};
+
+  summaries_.emplace_back(summary{found->first.first, jresponse.dump()});
+  batches_.erase(found);
+}
+} // namespace hl
@@ -1,44 +1,57 @@
 #include "clang_tokenize.hpp"
+#include "trace.hpp"
 #include <clang-c/Index.h>
 #include <vector>
 
 static const char *clang_errorToString(CXErrorCode code) noexcept;
 
-static std::string        get_token_group(const CXCursor &cursor) noexcept;
+static hl::arena_string   get_token_group(const CXCursor &cursor) noexcept;
 static hl::token_location get_token_location(CXTranslationUnit translation_unit,
                                              CXToken           token) noexcept;
-static std::string        map_token_kind(const CXCursorKind cursor_kind,
+static hl::arena_string   map_token_kind(const CXCursorKind cursor_kind,
                                          const CXTypeKind   type_kind) noexcept;
-static std::string        map_type_kind(CXTypeKind const type_kind) noexcept;
+static hl::arena_string   map_type_kind(CXTypeKind const type_kind) noexcept;
+static void               collect_include(CXFile            included_file,
+                                          CXSourceLocation *inclusion_stack,
+                                          unsigned int      include_len,
+                                          CXClientData      client_data);
+
+struct include_collector {
+  CXTranslationUnit         translation_unit;
+  std::vector<std::string> *includes;
+};
 
 namespace hl {
-hl::token_list clang_tokenize(const char * filename,
-                              int          argc,
-                              const char * argv[],
-                              std::string &err) noexcept {
-  hl::token_list        retval;
-  CXIndex               index;
-  CXTranslationUnit     translation_unit;
-  CXErrorCode           error_code;
-  CXFile                tru_file;
-  size_t                file_offset;
-  CXSourceLocation      begin_loc;
-  CXSourceLocation      end_loc;
-  CXSourceRange         range;
-  CXToken *             cx_tokens = nullptr;
-  unsigned int          num_tokens;
-  std::vector<CXCursor> cursors;
+hl::token_list clang_tokenize(const char *              filename,
+                              int                       argc,
+                              const char *              argv[],
+                              unsigned int              options,
+                              std::vector<std::string> *includes,
+                              std::string &             err) noexcept {
+  hl::token_list             retval;
+  CXIndex                    index;
+  CXTranslationUnit          translation_unit;
+  CXErrorCode                error_code;
+  CXFile                     tru_file;
+  size_t                     file_offset;
+  CXSourceLocation           begin_loc;
+  CXSourceLocation           end_loc;
+  CXSourceRange              range;
+  CXToken *                  cx_tokens = nullptr;
+  unsigned int               num_tokens;
+  hl::arena_vector<CXCursor> cursors;
+
+  hl::trace::clock::time_point phase_start = hl::trace::clock::now();
 
   index = clang_createIndex(0, 0);
-  error_code =
-      clang_parseTranslationUnit2(index,
-                                  filename,
-                                  argv,
-                                  argc,
-                                  nullptr,
-                                  0,
-                                  CXTranslationUnit_DetailedPreprocessingRecord,
-                                  &translation_unit);
+  error_code = clang_parseTranslationUnit2(index,
+                                           filename,
+                                           argv,
+                                           argc,
+                                           nullptr,
+                                           0,
+                                           options,
+                                           &translation_unit);
 
   if (error_code != CXError_Success) {
     err = clang_errorToString(error_code);
@@ -64,6 +77,13 @@ hl::token_list clang_tokenize(const char * filename,
     clang_disposeDiagnostic(diag);
   }
 
+  hl::trace::phase("parse", phase_start);
+
+  if (includes != nullptr) {
+    include_collector collector{translation_unit, includes};
+    clang_getInclusions(translation_unit, collect_include, &collector);
+  }
+
   tru_file = clang_getFile(translation_unit, filename);
   if (tru_file == nullptr) {
     err = "can't get handling file from translation unit";
@@ -78,7 +98,9 @@ hl::token_list clang_tokenize(const char * filename,
 
 
   // tokenization
+  phase_start = hl::trace::clock::now();
   ::clang_tokenize(translation_unit, range, &cx_tokens, &num_tokens);
+  hl::trace::phase("tokenize", phase_start);
 
   if (cx_tokens == nullptr) {
     err = "no tokens";
@@ -87,6 +109,7 @@ hl::token_list clang_tokenize(const char * filename,
 
 
   // get annotated tokens
+  phase_start = hl::trace::clock::now();
   cursors.resize(num_tokens);
   clang_annotateTokens(translation_unit, cx_tokens, num_tokens, cursors.data());
 
@@ -99,10 +122,11 @@ hl::token_list clang_tokenize(const char * filename,
     }
 
     CXCursor &     cursor   = cursors[i];
-    std::string    group    = get_token_group(cursor);
+    arena_string   group    = get_token_group(cursor);
     token_location location = get_token_location(translation_unit, cx_token);
-    retval.emplace_back(token{group, location});
+    retval.emplace_back(token{std::move(group), location});
   }
+  hl::trace::phase("annotate", phase_start);
 
 
 Finish:
@@ -135,7 +159,29 @@ static const char *clang_errorToString(CXErrorCode code) noexcept {
 }
 
 
-static std::string get_token_group(const CXCursor &cursor) noexcept {
+static void collect_include(CXFile       included_file,
+                            CXSourceLocation *,
+                            unsigned int include_len,
+                            CXClientData client_data) {
+  // the main file has empty inclusion stack
+  if (include_len == 0) {
+    return;
+  }
+
+  include_collector *collector = static_cast<include_collector *>(client_data);
+  CXSourceLocation   start =
+      clang_getLocationForOffset(collector->translation_unit, included_file, 0);
+  if (clang_Location_isInSystemHeader(start)) {
+    return;
+  }
+
+  CXString name = clang_getFileName(included_file);
+  collector->includes->emplace_back(clang_getCString(name));
+  clang_disposeString(name);
+}
+
+
+static hl::arena_string get_token_group(const CXCursor &cursor) noexcept {
   CXTypeKind   type_kind   = clang_getCursorType(cursor).kind;
   CXCursorKind cursor_kind = clang_getCursorKind(cursor);
 
@@ -158,8 +204,8 @@ static hl::token_location get_token_location(CXTranslationUnit translation_unit,
   return hl::token_location{line, column, endOffset - beginOffset};
 }
 
-static std::string map_token_kind(const CXCursorKind cursor_kind,
-                                  const CXTypeKind   type_kind) noexcept {
+static hl::arena_string map_token_kind(const CXCursorKind cursor_kind,
+                                       const CXTypeKind   type_kind) noexcept {
   switch (cursor_kind) {
   case CXCursor_DeclRefExpr:
   case CXCursor_VarDecl:
@@ -168,13 +214,13 @@ static std::string map_token_kind(const CXCursorKind cursor_kind,
     break;
   }
 
-  CXString    cursorKindSpelling = clang_getCursorKindSpelling(cursor_kind);
-  std::string retval             = clang_getCString(cursorKindSpelling);
+  CXString         cursorKindSpelling = clang_getCursorKindSpelling(cursor_kind);
+  hl::arena_string retval             = clang_getCString(cursorKindSpelling);
   clang_disposeString(cursorKindSpelling);
   return retval;
 }
 
-static std::string map_type_kind(CXTypeKind const type_kind) noexcept {
+static hl::arena_string map_type_kind(CXTypeKind const type_kind) noexcept {
   switch (type_kind) {
   case CXType_Void:
   case CXType_Bool:
@@ -246,8 +292,8 @@ static std::string map_type_kind(CXTypeKind const type_kind) noexcept {
     break;
   }
 
-  CXString    typeSpelling = clang_getTypeKindSpelling(type_kind);
-  std::string retval       = clang_getCString(typeSpelling);
+  CXString         typeSpelling = clang_getTypeKindSpelling(type_kind);
+  hl::arena_string retval       = clang_getCString(typeSpelling);
   clang_disposeString(typeSpelling);
   return retval;
 }
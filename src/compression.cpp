@@ -0,0 +1,72 @@
+#include "compression.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <zlib.h>
+
+#define COMPRESSION_LEVEL 1 // responses are compressed well by fastest level
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void append_base64(std::string &         out,
+                          const unsigned char *data,
+                          size_t               size);
+
+namespace hl {
+bool compress_frame(const std::string &response, std::string &frame) {
+  uLongf      compressed_size = compressBound(response.size());
+  std::string compressed(compressed_size, '\0');
+
+  int result = compress2(reinterpret_cast<Bytef *>(&compressed[0]),
+                         &compressed_size,
+                         reinterpret_cast<const Bytef *>(response.data()),
+                         response.size(),
+                         COMPRESSION_LEVEL);
+  if (result != Z_OK) {
+    LOG_ERROR("can't compress response: %s", zError(result));
+    return false;
+  }
+
+  frame.clear();
+  frame.reserve(1 + (compressed_size + 2) / 3 * 4);
+  frame += COMPRESSED_FRAME_MARK;
+  append_base64(frame,
+                reinterpret_cast<const unsigned char *>(compressed.data()),
+                compressed_size);
+
+  ALOG_DEBUG("response compressed: %.1fKb -> %.1fKb",
+             response.size() / 1024.,
+             frame.size() / 1024.);
+  return true;
+}
+} // namespace hl
+
+
+static void append_base64(std::string &         out,
+                          const unsigned char *data,
+                          size_t               size) {
+  size_t offset = out.size();
+  out.resize(offset + (size + 2) / 3 * 4);
+
+  char * cur = &out[offset];
+  size_t i   = 0;
+  for (; i + 2 < size; i += 3) {
+    unsigned int triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *cur++              = base64_alphabet[(triple >> 18) & 0x3f];
+    *cur++              = base64_alphabet[(triple >> 12) & 0x3f];
+    *cur++              = base64_alphabet[(triple >> 6) & 0x3f];
+    *cur++              = base64_alphabet[triple & 0x3f];
+  }
+
+  if (i < size) {
+    unsigned int triple = data[i] << 16;
+    if (i + 1 < size) {
+      triple |= data[i + 1] << 8;
+    }
+
+    *cur++ = base64_alphabet[(triple >> 18) & 0x3f];
+    *cur++ = base64_alphabet[(triple >> 12) & 0x3f];
+    *cur++ = i + 1 < size ? base64_alphabet[(triple >> 6) & 0x3f] : '=';
+    *cur++ = '=';
+  }
+}
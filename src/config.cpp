@@ -0,0 +1,91 @@
+#include "config.hpp"
+#include <climits>
+#include <exception>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+#define FLAG_TAG               "flag"
+#define VERBOSE_TAG            "verbose"
+#define MAX_INFLIGHT_TAG       "max-inflight"
+#define MAX_QUEUED_TAG         "max-queued"
+#define MAX_QUEUE_COST_TAG     "max-queue-cost"
+#define COMPRESS_THRESHOLD_TAG "compress-threshold"
+
+static bool read_int(const nlohmann::json &value,
+                     int                   minimum,
+                     int &                 out,
+                     std::string &         err);
+
+namespace hl {
+bool read_config(const char *path, server_config &config, std::string &err) {
+  using nlohmann::json;
+
+  server_config retval = config;
+  std::ifstream file{path};
+  if (file.is_open() == false) {
+    err = "can't open file";
+    return false;
+  }
+
+  try {
+    json jconfig = json::parse(file);
+    if (jconfig.is_object() == false) {
+      err = "config must be json object";
+      return false;
+    }
+
+    for (json::iterator item = jconfig.begin(); item != jconfig.end();
+         ++item) {
+      const std::string &key = item.key();
+      bool               ok  = true;
+      if (key == FLAG_TAG) {
+        retval.default_flags = item->get<std::vector<std::string>>();
+      } else if (key == VERBOSE_TAG) {
+        retval.verbose = item->get<bool>();
+      } else if (key == MAX_INFLIGHT_TAG) {
+        ok = read_int(*item, 1, retval.max_inflight, err);
+      } else if (key == MAX_QUEUED_TAG) {
+        ok = read_int(*item, 0, retval.max_queued, err);
+      } else if (key == MAX_QUEUE_COST_TAG) {
+        ok = read_int(*item, 0, retval.max_queue_cost, err);
+      } else if (key == COMPRESS_THRESHOLD_TAG) {
+        ok = read_int(*item, 0, retval.compress_threshold, err);
+      } else {
+        err = "unknown key: " + key;
+        return false;
+      }
+
+      if (ok == false) {
+        err = key + ": " + err;
+        return false;
+      }
+    }
+  } catch (std::exception &e) {
+    err = e.what();
+    return false;
+  }
+
+  config = std::move(retval);
+  return true;
+}
+} // namespace hl
+
+
+static bool read_int(const nlohmann::json &value,
+                     int                   minimum,
+                     int &                 out,
+                     std::string &         err) {
+  if (value.is_number_integer() == false) {
+    err = "integer expected";
+    return false;
+  }
+
+  long long number = value.get<long long>();
+  if (number < minimum || number > INT_MAX) {
+    err = "must be not less then " + std::to_string(minimum);
+    return false;
+  }
+
+  out = static_cast<int>(number);
+  return true;
+}
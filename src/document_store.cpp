@@ -0,0 +1,154 @@
+#include "document_store.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <cstring>
+
+static bool to_offset(const std::string &body,
+                      unsigned int       row,
+                      unsigned int       column,
+                      size_t &           offset) noexcept;
+
+namespace hl {
+document_store::document_store(size_t max_bytes)
+    : max_bytes_{max_bytes}
+    , bytes_{0} {
+}
+
+void document_store::update(const std::string &client,
+                            const std::string &buf_name,
+                            long long          version,
+                            const std::string &body) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  key_type key{client, buf_name};
+  auto     found = documents_.find(key);
+  if (found == documents_.end()) {
+    usage_.push_front(key);
+    found = documents_.emplace(key, document{version, "", usage_.begin()}).first;
+  } else {
+    usage_.splice(usage_.begin(), usage_, found->second.usage);
+  }
+
+  bytes_ -= found->second.body.size();
+  found->second.version = version;
+  found->second.body    = body;
+  bytes_ += found->second.body.size();
+
+  this->shrink();
+}
+
+bool document_store::apply(const std::string &           client,
+                           const std::string &           buf_name,
+                           long long                     base_version,
+                           long long                     version,
+                           const std::vector<text_edit> &edits,
+                           std::string &                 body,
+                           std::string &                 err) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = documents_.find(key_type{client, buf_name});
+  if (found == documents_.end()) {
+    err = "unknown buffer";
+    return false;
+  }
+
+  document &doc = found->second;
+  if (doc.version != base_version) {
+    err = "buffer has version " + std::to_string(doc.version) + ", but " +
+          std::to_string(base_version) + " expected";
+    goto Failure;
+  }
+
+  for (const text_edit &edit : edits) {
+    size_t start = 0;
+    size_t end   = 0;
+    if (to_offset(doc.body, edit.range[0], edit.range[1], start) == false ||
+        to_offset(doc.body, edit.range[2], edit.range[3], end) == false ||
+        start > end) {
+      err = "invalid edit range";
+      goto Failure;
+    }
+
+    bytes_ -= doc.body.size();
+    doc.body.replace(start, end - start, edit.text);
+    bytes_ += doc.body.size();
+  }
+
+  doc.version = version;
+  usage_.splice(usage_.begin(), usage_, doc.usage);
+  body = doc.body;
+
+  this->shrink();
+  return true;
+
+Failure:
+  bytes_ -= doc.body.size();
+  usage_.erase(doc.usage);
+  documents_.erase(found);
+  return false;
+}
+
+bool document_store::get(const std::string &client,
+                         const std::string &buf_name,
+                         std::string &      body) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = documents_.find(key_type{client, buf_name});
+  if (found == documents_.end()) {
+    return false;
+  }
+
+  usage_.splice(usage_.begin(), usage_, found->second.usage);
+  body = found->second.body;
+  return true;
+}
+
+void document_store::shrink() {
+  while (bytes_ > max_bytes_ && usage_.size() > 1) {
+    auto found = documents_.find(usage_.back());
+
+    ALOG_DEBUG("remove buffer %s from document store",
+               found->first.second.c_str());
+
+    bytes_ -= found->second.body.size();
+    documents_.erase(found);
+    usage_.pop_back();
+  }
+}
+} // namespace hl
+
+
+static bool to_offset(const std::string &body,
+                      unsigned int       row,
+                      unsigned int       column,
+                      size_t &           offset) noexcept {
+  if (row == 0 || column == 0) {
+    return false;
+  }
+
+  const char *begin      = body.c_str();
+  const char *end        = begin + body.size();
+  const char *line_start = begin;
+  for (unsigned int i = 1; i < row; ++i) {
+    const char *found =
+        static_cast<const char *>(memchr(line_start, '\n', end - line_start));
+    if (found == nullptr) {
+      return false;
+    }
+    line_start = found + 1;
+  }
+
+  const char *line_end =
+      static_cast<const char *>(memchr(line_start, '\n', end - line_start));
+  if (line_end == nullptr) {
+    line_end = end;
+  }
+
+  // column after last symbol of line is allowed
+  if (column - 1 > static_cast<size_t>(line_end - line_start)) {
+    return false;
+  }
+
+  offset = (line_start - begin) + column - 1;
+  return true;
+}
@@ -0,0 +1,137 @@
+#include "hash.hpp"
+#include <cstring>
+
+#define PRIME64_1 0x9E3779B185EBCA87ull
+#define PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define PRIME64_3 0x165667B19E3779F9ull
+#define PRIME64_4 0x85EBCA77C2B2AE63ull
+#define PRIME64_5 0x27D4EB2F165667C5ull
+
+static uint64_t rotl(uint64_t value, int bits) noexcept;
+static uint64_t read64(const unsigned char *data) noexcept;
+static uint32_t read32(const unsigned char *data) noexcept;
+static uint64_t xxh_round(uint64_t acc, uint64_t input) noexcept;
+static uint64_t xxh_merge_round(uint64_t acc, uint64_t value) noexcept;
+
+namespace hl {
+hasher::hasher(uint64_t seed) noexcept
+    : state_{seed + PRIME64_1 + PRIME64_2,
+             seed + PRIME64_2,
+             seed,
+             seed - PRIME64_1}
+    , buffer_{}
+    , buffered_{0}
+    , total_{0}
+    , seed_{seed} {
+}
+
+void hasher::update(const std::string &str) noexcept {
+  this->update(str.data(), str.size());
+}
+
+void hasher::update(const void *data, size_t size) noexcept {
+  const unsigned char *input = static_cast<const unsigned char *>(data);
+  const unsigned char *end   = input + size;
+
+  total_ += size;
+
+  if (buffered_ + size < sizeof(buffer_)) {
+    memcpy(buffer_ + buffered_, input, size);
+    buffered_ += size;
+    return;
+  }
+
+  if (buffered_ != 0) {
+    size_t rest = sizeof(buffer_) - buffered_;
+    memcpy(buffer_ + buffered_, input, rest);
+    input += rest;
+
+    for (int i = 0; i < 4; ++i) {
+      state_[i] = xxh_round(state_[i], read64(buffer_ + i * 8));
+    }
+    buffered_ = 0;
+  }
+
+  while (end - input >= 32) {
+    for (int i = 0; i < 4; ++i) {
+      state_[i] = xxh_round(state_[i], read64(input + i * 8));
+    }
+    input += 32;
+  }
+
+  buffered_ = end - input;
+  memcpy(buffer_, input, buffered_);
+}
+
+uint64_t hasher::digest() const noexcept {
+  uint64_t retval;
+
+  if (total_ >= 32) {
+    retval = rotl(state_[0], 1) + rotl(state_[1], 7) + rotl(state_[2], 12) +
+             rotl(state_[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      retval = xxh_merge_round(retval, state_[i]);
+    }
+  } else {
+    retval = seed_ + PRIME64_5;
+  }
+
+  retval += total_;
+
+  const unsigned char *input = buffer_;
+  const unsigned char *end   = buffer_ + buffered_;
+  while (end - input >= 8) {
+    retval ^= xxh_round(0, read64(input));
+    retval = rotl(retval, 27) * PRIME64_1 + PRIME64_4;
+    input += 8;
+  }
+  if (end - input >= 4) {
+    retval ^= static_cast<uint64_t>(read32(input)) * PRIME64_1;
+    retval = rotl(retval, 23) * PRIME64_2 + PRIME64_3;
+    input += 4;
+  }
+  while (input != end) {
+    retval ^= (*input) * PRIME64_5;
+    retval = rotl(retval, 11) * PRIME64_1;
+    ++input;
+  }
+
+  retval ^= retval >> 33;
+  retval *= PRIME64_2;
+  retval ^= retval >> 29;
+  retval *= PRIME64_3;
+  retval ^= retval >> 32;
+  return retval;
+}
+} // namespace hl
+
+
+static uint64_t rotl(uint64_t value, int bits) noexcept {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char *data) noexcept {
+  uint64_t retval;
+  memcpy(&retval, data, sizeof(retval));
+  return retval;
+}
+
+static uint32_t read32(const unsigned char *data) noexcept {
+  uint32_t retval;
+  memcpy(&retval, data, sizeof(retval));
+  return retval;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) noexcept {
+  acc += input * PRIME64_2;
+  acc = rotl(acc, 31);
+  acc *= PRIME64_1;
+  return acc;
+}
+
+static uint64_t xxh_merge_round(uint64_t acc, uint64_t value) noexcept {
+  value = xxh_round(0, value);
+  acc ^= value;
+  acc = acc * PRIME64_1 + PRIME64_4;
+  return acc;
+}
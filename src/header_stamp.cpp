@@ -0,0 +1,122 @@
+#include "header_stamp.hpp"
+#include <cstring>
+#include <sys/stat.h>
+
+static bool stat_header(const std::string &path,
+                        int64_t &          mtime,
+                        int64_t &          size) noexcept;
+static void append_int(std::string &out, uint64_t value);
+static bool
+read_int(const char *&cur, const char *end, uint64_t &out) noexcept;
+
+namespace hl {
+bool make_stamps(const std::vector<std::string> &      headers,
+                 std::chrono::system_clock::time_point not_after,
+                 header_stamps &                       out) {
+  int64_t limit = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      not_after.time_since_epoch())
+                      .count();
+
+  out.clear();
+  out.reserve(headers.size());
+  for (const std::string &header : headers) {
+    header_stamp stamp{header, 0, 0};
+    if (stat_header(header, stamp.mtime, stamp.size) == false ||
+        stamp.mtime > limit) {
+      return false;
+    }
+
+    out.emplace_back(std::move(stamp));
+  }
+
+  return true;
+}
+
+bool stamps_valid(const header_stamps &stamps) {
+  for (const header_stamp &stamp : stamps) {
+    int64_t mtime = 0;
+    int64_t size  = 0;
+    if (stat_header(stamp.path, mtime, size) == false ||
+        mtime != stamp.mtime || size != stamp.size) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void write_stamps(const header_stamps &stamps, std::string &out) {
+  append_int(out, stamps.size());
+  for (const header_stamp &stamp : stamps) {
+    append_int(out, stamp.path.size());
+    out += stamp.path;
+    append_int(out, stamp.mtime);
+    append_int(out, stamp.size);
+  }
+}
+
+bool read_stamps(const char *data, size_t size, header_stamps &out) {
+  const char *cur   = data;
+  const char *end   = data + size;
+  uint64_t    count = 0;
+
+  out.clear();
+  if (read_int(cur, end, count) == false) {
+    return false;
+  }
+
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t path_size = 0;
+    uint64_t mtime     = 0;
+    uint64_t file_size = 0;
+    if (read_int(cur, end, path_size) == false ||
+        path_size > uint64_t(end - cur)) {
+      return false;
+    }
+
+    std::string path{cur, cur + path_size};
+    cur += path_size;
+    if (read_int(cur, end, mtime) == false ||
+        read_int(cur, end, file_size) == false) {
+      return false;
+    }
+
+    out.emplace_back(header_stamp{std::move(path),
+                                  static_cast<int64_t>(mtime),
+                                  static_cast<int64_t>(file_size)});
+  }
+
+  return cur == end;
+}
+} // namespace hl
+
+
+static bool stat_header(const std::string &path,
+                        int64_t &          mtime,
+                        int64_t &          size) noexcept {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+
+  mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  size  = st.st_size;
+  return true;
+}
+
+static void append_int(std::string &out, uint64_t value) {
+  char buf[sizeof(value)];
+  memcpy(buf, &value, sizeof(value));
+  out.append(buf, sizeof(buf));
+}
+
+static bool
+read_int(const char *&cur, const char *end, uint64_t &out) noexcept {
+  if (size_t(end - cur) < sizeof(out)) {
+    return false;
+  }
+
+  memcpy(&out, cur, sizeof(out));
+  cur += sizeof(out);
+  return true;
+}
@@ -0,0 +1,294 @@
+#include "header_watcher.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS                                                           \
+  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR)
+#define REFRESH_DELAY_MS 200 // after the last change of headers
+#define EVENTS_BUF_SIZE  64 * 1024
+
+static bool real_path(const std::string &path, std::string &out);
+
+namespace hl {
+header_watcher::header_watcher(size_t max_buffers)
+    : max_buffers_{max_buffers}
+    , fd_{-1} {
+}
+
+header_watcher::~header_watcher() {
+  // all watches are removed with the descriptor
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool header_watcher::start() {
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    LOG_ERROR("can't initialize inotify: %s", strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+int header_watcher::fd() const noexcept {
+  return fd_;
+}
+
+void header_watcher::watch(uint64_t                        client,
+                           const std::string &             buf_name,
+                           const std::vector<std::string> &headers,
+                           std::string                     request) {
+  key_type key{client, buf_name};
+  auto     found = buffers_.find(key);
+  if (found == buffers_.end()) {
+    usage_.push_front(key);
+    found = buffers_.emplace(key, buffer{{}, {}, "", usage_.begin()}).first;
+  } else {
+    usage_.splice(usage_.begin(), usage_, found->second.usage);
+  }
+  found->second.request = std::move(request);
+
+  // usually headers are not changed between requests
+  if (found->second.headers != headers) {
+    for (const std::string &path : found->second.paths) {
+      this->remove_path(key, path);
+    }
+    found->second.paths.clear();
+
+    bool resolved = true;
+    for (const std::string &header : headers) {
+      std::string path;
+      if (real_path(header, path) == false) {
+        resolved = false;
+        continue;
+      }
+
+      this->add_path(key, path);
+      found->second.paths.emplace_back(std::move(path));
+    }
+
+    // not existing headers (for example not generated yet) are tried again
+    // after the next request
+    found->second.headers = resolved ? headers : std::vector<std::string>{};
+
+    ALOG_DEBUG("watch %zu headers of %s",
+               found->second.paths.size(),
+               buf_name.c_str());
+  }
+
+  while (buffers_.size() > max_buffers_) {
+    this->remove_buffer(buffers_.find(usage_.back()));
+  }
+}
+
+void header_watcher::remove_client(uint64_t client) {
+  auto found = buffers_.lower_bound(key_type{client, ""});
+  while (found != buffers_.end() && found->first.first == client) {
+    auto next = std::next(found);
+    this->remove_buffer(found);
+    found = next;
+  }
+}
+
+void header_watcher::handle_events() {
+  // XXX buffer for inotify events must be aligned
+  alignas(inotify_event) char buf[EVENTS_BUF_SIZE];
+
+  for (;;) {
+    ssize_t count = read(fd_, buf, sizeof(buf));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG_ERROR("can't read inotify events: %s", strerror(errno));
+      }
+      return;
+    }
+
+    clock::time_point now = clock::now();
+    for (char *cur = buf; cur < buf + count;) {
+      const inotify_event *event = reinterpret_cast<inotify_event *>(cur);
+      cur += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        ALOG_WARNING("inotify queue overflow, some changes of headers are lost");
+        continue;
+      }
+
+      auto dir = watches_.find(event->wd);
+      if (dir == watches_.end()) {
+        continue;
+      }
+
+      // watch is removed by system, for example with the directory
+      if (event->mask & IN_IGNORED) {
+        this->forget_directory(dir->second, now);
+        continue;
+      }
+
+      if (event->len == 0) {
+        continue;
+      }
+
+      auto file = files_.find(dir->second + '/' + event->name);
+      if (file == files_.end()) {
+        continue;
+      }
+
+      ALOG_DEBUG("header %s is changed", file->first.c_str());
+      for (const key_type &key : file->second) {
+        changed_[key] = now;
+      }
+    }
+  }
+}
+
+std::list<header_watcher::refresh> header_watcher::take_refreshes() {
+  std::list<refresh> retval;
+  clock::time_point  now = clock::now();
+
+  for (auto iter = changed_.begin(); iter != changed_.end();) {
+    if (now - iter->second < std::chrono::milliseconds{REFRESH_DELAY_MS}) {
+      ++iter;
+      continue;
+    }
+
+    auto found = buffers_.find(iter->first);
+    if (found != buffers_.end()) {
+      ALOG_DEBUG("refresh %s", iter->first.second.c_str());
+      retval.emplace_back(refresh{iter->first.first, found->second.request});
+    }
+    iter = changed_.erase(iter);
+  }
+
+  return retval;
+}
+
+int header_watcher::timeout_ms() const {
+  if (changed_.empty()) {
+    return -1;
+  }
+
+  clock::time_point first = changed_.begin()->second;
+  for (const auto &item : changed_) {
+    first = std::min(first, item.second);
+  }
+
+  long long passed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         clock::now() - first)
+                         .count();
+  return passed < REFRESH_DELAY_MS ? REFRESH_DELAY_MS - passed : 0;
+}
+
+void header_watcher::add_path(const key_type &key, const std::string &path) {
+  std::set<key_type> &buffers = files_[path];
+  if (buffers.insert(key).second == false || buffers.size() != 1) {
+    return;
+  }
+
+  // the first watched file in the directory
+  std::string dir_path = path.substr(0, path.rfind('/'));
+  auto        dir      = dirs_.find(dir_path);
+  if (dir == dirs_.end()) {
+    int wd = inotify_add_watch(fd_,
+                               dir_path.empty() ? "/" : dir_path.c_str(),
+                               WATCH_EVENTS);
+    if (wd < 0) {
+      ALOG_WARNING("can't watch directory %s: %s",
+                   dir_path.c_str(),
+                   strerror(errno));
+      files_.erase(path);
+      return;
+    }
+
+    dir = dirs_.emplace(dir_path, directory{wd, 0}).first;
+    watches_[wd] = dir_path;
+  }
+  ++dir->second.files;
+}
+
+void header_watcher::remove_path(const key_type &   key,
+                                 const std::string &path) {
+  auto file = files_.find(path);
+  if (file == files_.end() || file->second.erase(key) == 0 ||
+      file->second.empty() == false) {
+    return;
+  }
+  files_.erase(file);
+
+  // the last watched file in the directory
+  auto dir = dirs_.find(path.substr(0, path.rfind('/')));
+  if (dir == dirs_.end() || --dir->second.files != 0) {
+    return;
+  }
+
+  inotify_rm_watch(fd_, dir->second.wd);
+  watches_.erase(dir->second.wd);
+  dirs_.erase(dir);
+}
+
+void header_watcher::remove_buffer(std::map<key_type, buffer>::iterator found) {
+  for (const std::string &path : found->second.paths) {
+    this->remove_path(found->first, path);
+  }
+
+  changed_.erase(found->first);
+  usage_.erase(found->second.usage);
+  buffers_.erase(found);
+}
+
+void header_watcher::forget_directory(std::string       dir_path,
+                                      clock::time_point now) {
+  std::string prefix = dir_path + '/';
+  for (auto file = files_.begin(); file != files_.end();) {
+    // only files directly in the directory
+    if (file->first.compare(0, prefix.size(), prefix) != 0 ||
+        file->first.find('/', prefix.size()) != std::string::npos) {
+      ++file;
+      continue;
+    }
+
+    // XXX headers are not the same anymore, so the next watch adds them again
+    for (const key_type &key : file->second) {
+      auto found = buffers_.find(key);
+      if (found != buffers_.end()) {
+        std::vector<std::string> &paths = found->second.paths;
+        paths.erase(std::remove(paths.begin(), paths.end(), file->first),
+                    paths.end());
+        found->second.headers.clear();
+      }
+      changed_[key] = now;
+    }
+    file = files_.erase(file);
+  }
+
+  auto dir = dirs_.find(dir_path);
+  if (dir != dirs_.end()) {
+    watches_.erase(dir->second.wd);
+    dirs_.erase(dir);
+  }
+
+  ALOG_DEBUG("directory %s is not watched anymore", dir_path.c_str());
+}
+} // namespace hl
+
+
+static bool real_path(const std::string &path, std::string &out) {
+  char resolved[PATH_MAX];
+  if (realpath(path.c_str(), resolved) == nullptr) {
+    return false;
+  }
+
+  out = resolved;
+  return true;
+}
@@ -0,0 +1,565 @@
+#include "lexical_tokenize.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#define KEYWORD_GROUP          "Keyword"
+#define COMMENT_GROUP          "Comment"
+#define STRING_GROUP           "StringLiteral"
+#define CHARACTER_GROUP        "CharacterLiteral"
+#define INTEGER_GROUP          "IntegerLiteral"
+#define FLOATING_GROUP         "FloatingLiteral"
+#define DIRECTIVE_GROUP        "preprocessing directive"
+#define INCLUSION_GROUP        "inclusion directive"
+#define MACRO_DEFINITION_GROUP "macro definition"
+#define MACRO_EXPANSION_GROUP  "macro expansion"
+#define FUNCTION_GROUP         "Function"
+#define MEMBER_GROUP           "MemberRefExpr"
+#define TYPE_GROUP             "TypeRef"
+#define NAMESPACE_GROUP        "Namespace"
+
+#define CHAR_SPACE 0x01 // except new line
+#define CHAR_IDENT 0x02 // letters, underscore, dollar and not ascii bytes
+#define CHAR_DIGIT 0x04
+
+#define MAX_RAW_DELIMITER 16
+
+
+// XXX must be sorted
+static const char *const keywords[] = {
+    "_Alignas",      "_Alignof",         "_Atomic",       "_Bool",
+    "_Complex",      "_Generic",         "_Imaginary",    "_Noreturn",
+    "_Static_assert", "_Thread_local",   "alignas",       "alignof",
+    "and",           "and_eq",           "asm",           "auto",
+    "bitand",        "bitor",            "bool",          "break",
+    "case",          "catch",            "char",          "char16_t",
+    "char32_t",      "char8_t",          "class",         "co_await",
+    "co_return",     "co_yield",         "compl",         "concept",
+    "const",         "const_cast",       "consteval",     "constexpr",
+    "constinit",     "continue",         "decltype",      "default",
+    "delete",        "do",               "double",        "dynamic_cast",
+    "else",          "enum",             "explicit",      "export",
+    "extern",        "false",            "float",         "for",
+    "friend",        "goto",             "if",            "inline",
+    "int",           "long",             "mutable",       "namespace",
+    "new",           "noexcept",         "not",           "not_eq",
+    "nullptr",       "operator",         "or",            "or_eq",
+    "private",       "protected",        "public",        "register",
+    "reinterpret_cast", "requires",      "restrict",      "return",
+    "short",         "signed",           "sizeof",        "static",
+    "static_assert", "static_cast",      "struct",        "switch",
+    "template",      "this",             "thread_local",  "throw",
+    "true",          "try",              "typedef",       "typeid",
+    "typename",      "union",            "unsigned",      "using",
+    "virtual",       "void",             "volatile",      "wchar_t",
+    "while",         "xor",              "xor_eq"};
+
+enum previous_kind {
+  PreviousOther,
+  PreviousMember,    // . or ->
+  PreviousNamespace, // namespace keyword
+  PreviousStruct,
+  PreviousClass,
+  PreviousUnion,
+  PreviousEnum,
+};
+
+enum directive_kind {
+  DirectiveNone,
+  DirectiveOther,
+  DirectiveDefine,
+  DirectiveInclude,
+};
+
+struct scan_state {
+  const char *   end;
+  const char *   line; // begin of current line
+  unsigned int   row;
+  bool           line_start; // only spaces before current position in line
+  previous_kind  previous;
+  directive_kind directive;
+  hl::token_list tokens;
+};
+
+static unsigned char char_table[256];
+
+static bool init_char_table() noexcept;
+static bool is_keyword(const char *begin, const char *end) noexcept;
+static bool equal(const char *begin, const char *end, const char *str) noexcept;
+static bool is_macro_like(const char *begin, const char *end) noexcept;
+static const char *skip_spaces(const char *cur, const char *end) noexcept;
+
+static void add_token(scan_state &state,
+                      const char *group,
+                      const char *begin,
+                      const char *end);
+static void add_multiline_token(scan_state &state,
+                                const char *group,
+                                const char *begin,
+                                const char *end);
+
+static const char *scan_block_comment(scan_state &state, const char *cur);
+static const char *scan_quoted(scan_state &state,
+                               const char *group,
+                               const char *begin,
+                               const char *quote);
+static const char *scan_raw_string(scan_state &state,
+                                   const char *begin,
+                                   const char *quote);
+static const char *scan_number(scan_state &state, const char *cur);
+static const char *scan_directive(scan_state &state, const char *cur);
+static const char *scan_identifier(scan_state &state, const char *cur);
+
+static inline bool has_class(char c, unsigned char char_class) noexcept {
+  return char_table[static_cast<unsigned char>(c)] & char_class;
+}
+
+
+namespace hl {
+hl::token_list lexical_tokenize(const char *data, size_t size) {
+  static bool initialized = init_char_table();
+  (void)initialized;
+
+  scan_state state{data + size,
+                   data,
+                   1,
+                   true,
+                   PreviousOther,
+                   DirectiveNone,
+                   {}};
+
+  const char *cur = data;
+  const char *end = data + size;
+  while (cur < end) {
+    char c = *cur;
+
+    if (has_class(c, CHAR_SPACE)) {
+      ++cur;
+      continue;
+    }
+
+    if (c == '\n') {
+      // directive continues after escaped new line
+      if (state.directive != DirectiveNone &&
+          (cur == data || cur[-1] != '\\') &&
+          (cur - data < 2 || cur[-1] != '\r' || cur[-2] != '\\')) {
+        state.directive = DirectiveNone;
+      }
+
+      ++cur;
+      ++state.row;
+      state.line       = cur;
+      state.line_start = true;
+      continue;
+    }
+
+    if (c == '/' && cur + 1 < end && cur[1] == '/') {
+      const char *found =
+          static_cast<const char *>(memchr(cur, '\n', end - cur));
+      const char *comment_end = found ? found : end;
+      add_token(state, COMMENT_GROUP, cur, comment_end);
+      cur = comment_end;
+      continue;
+    }
+
+    if (c == '/' && cur + 1 < end && cur[1] == '*') {
+      cur = scan_block_comment(state, cur);
+      continue;
+    }
+
+    bool line_start  = state.line_start;
+    state.line_start = false;
+
+    if (c == '#' && line_start) {
+      cur = scan_directive(state, cur);
+      continue;
+    }
+
+    if (has_class(c, CHAR_DIGIT) ||
+        (c == '.' && cur + 1 < end && has_class(cur[1], CHAR_DIGIT))) {
+      cur            = scan_number(state, cur);
+      state.previous = PreviousOther;
+      continue;
+    }
+
+    if (c == '"') {
+      cur = scan_quoted(state,
+                        state.directive == DirectiveInclude ? INCLUSION_GROUP
+                                                            : STRING_GROUP,
+                        cur,
+                        cur);
+      state.previous = PreviousOther;
+      continue;
+    }
+
+    if (c == '\'') {
+      cur            = scan_quoted(state, CHARACTER_GROUP, cur, cur);
+      state.previous = PreviousOther;
+      continue;
+    }
+
+    if (c == '<' && state.directive == DirectiveInclude) {
+      const char *found =
+          static_cast<const char *>(memchr(cur, '>', end - cur));
+      const char *line_end =
+          static_cast<const char *>(memchr(cur, '\n', end - cur));
+      if (found && (line_end == nullptr || found < line_end)) {
+        add_token(state, INCLUSION_GROUP, cur, found + 1);
+        cur = found + 1;
+        continue;
+      }
+    }
+
+    if (has_class(c, CHAR_IDENT)) {
+      cur = scan_identifier(state, cur);
+      continue;
+    }
+
+    if (c == '.' || (c == '-' && cur + 1 < end && cur[1] == '>')) {
+      cur += c == '.' ? 1 : 2;
+      state.previous = PreviousMember;
+      continue;
+    }
+
+    ++cur;
+    state.previous = PreviousOther;
+  }
+
+  return std::move(state.tokens);
+}
+} // namespace hl
+
+
+static bool init_char_table() noexcept {
+  char_table[static_cast<unsigned char>(' ')]  = CHAR_SPACE;
+  char_table[static_cast<unsigned char>('\t')] = CHAR_SPACE;
+  char_table[static_cast<unsigned char>('\r')] = CHAR_SPACE;
+  char_table[static_cast<unsigned char>('\v')] = CHAR_SPACE;
+  char_table[static_cast<unsigned char>('\f')] = CHAR_SPACE;
+
+  for (int c = 'a'; c <= 'z'; ++c) {
+    char_table[c] = CHAR_IDENT;
+  }
+  for (int c = 'A'; c <= 'Z'; ++c) {
+    char_table[c] = CHAR_IDENT;
+  }
+  for (int c = '0'; c <= '9'; ++c) {
+    char_table[c] = CHAR_DIGIT;
+  }
+  for (int c = 0x80; c <= 0xff; ++c) {
+    char_table[c] = CHAR_IDENT;
+  }
+  char_table[static_cast<unsigned char>('_')] = CHAR_IDENT;
+  char_table[static_cast<unsigned char>('$')] = CHAR_IDENT;
+
+  return true;
+}
+
+static bool is_keyword(const char *begin, const char *end) noexcept {
+  size_t length = end - begin;
+
+  const char *const *found = std::lower_bound(
+      std::begin(keywords),
+      std::end(keywords),
+      begin,
+      [length](const char *keyword, const char *word) {
+        // the word isn't null terminated, so shorter keyword is less
+        int cmp = strncmp(keyword, word, length);
+        return cmp < 0;
+      });
+
+  return found != std::end(keywords) && equal(begin, end, *found);
+}
+
+static bool equal(const char *begin, const char *end, const char *str) noexcept {
+  size_t length = end - begin;
+  return strncmp(begin, str, length) == 0 && str[length] == '\0';
+}
+
+static bool is_macro_like(const char *begin, const char *end) noexcept {
+  // NAME or NAME_2, but not single letter template parameter
+  bool has_letter = false;
+  for (const char *cur = begin; cur < end; ++cur) {
+    if (*cur >= 'a' && *cur <= 'z') {
+      return false;
+    } else if (*cur >= 'A' && *cur <= 'Z') {
+      has_letter = true;
+    } else if (*cur != '_' && has_class(*cur, CHAR_DIGIT) == false) {
+      return false;
+    }
+  }
+
+  return has_letter && end - begin > 1;
+}
+
+static const char *skip_spaces(const char *cur, const char *end) noexcept {
+  while (cur < end && (has_class(*cur, CHAR_SPACE) || *cur == '\n')) {
+    ++cur;
+  }
+  return cur;
+}
+
+static void add_token(scan_state &state,
+                      const char *group,
+                      const char *begin,
+                      const char *end) {
+  unsigned int column = begin - state.line + 1;
+  unsigned int length = end - begin;
+  state.tokens.emplace_back(hl::token{group, {state.row, column, length}});
+}
+
+static void add_multiline_token(scan_state &state,
+                                const char *group,
+                                const char *begin,
+                                const char *end) {
+  // tokens can't be placed on several lines, so split it by lines
+  for (;;) {
+    const char *found =
+        static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (found == nullptr) {
+      break;
+    }
+
+    if (found != begin) {
+      add_token(state, group, begin, found);
+    }
+
+    begin = found + 1;
+    ++state.row;
+    state.line = begin;
+  }
+
+  if (begin != end) {
+    add_token(state, group, begin, end);
+  }
+}
+
+static const char *scan_block_comment(scan_state &state, const char *cur) {
+  const char *begin = cur;
+  const char *end   = state.end;
+
+  cur += 2;
+  for (;;) {
+    const char *found =
+        static_cast<const char *>(memchr(cur, '*', end - cur));
+    if (found == nullptr) {
+      cur = end;
+      break;
+    } else if (found + 1 < end && found[1] == '/') {
+      cur = found + 2;
+      break;
+    }
+    cur = found + 1;
+  }
+
+  add_multiline_token(state, COMMENT_GROUP, begin, cur);
+  return cur;
+}
+
+static const char *scan_quoted(scan_state &state,
+                               const char *group,
+                               const char *begin,
+                               const char *quote) {
+  const char *end = state.end;
+  const char *cur = quote + 1;
+
+  // not terminated literal finishes on end of line
+  while (cur < end && *cur != *quote && *cur != '\n') {
+    if (*cur == '\\' && cur + 1 < end) {
+      ++cur;
+    }
+    ++cur;
+  }
+  if (cur < end && *cur == *quote) {
+    ++cur;
+  }
+
+  add_multiline_token(state, group, begin, cur);
+  return cur;
+}
+
+static const char *scan_raw_string(scan_state &state,
+                                   const char *begin,
+                                   const char *quote) {
+  const char *end = state.end;
+
+  const char *open = quote + 1;
+  while (open < end && open - quote <= MAX_RAW_DELIMITER && *open != '(' &&
+         *open != '\n') {
+    ++open;
+  }
+  if (open >= end || *open != '(') {
+    // invalid raw string
+    return scan_quoted(state, STRING_GROUP, begin, quote);
+  }
+
+  // closing sequence is )delimiter"
+  std::string closing = ")";
+  closing.append(quote + 1, open);
+  closing += '"';
+
+  const char *found = static_cast<const char *>(
+      memmem(open + 1, end - open - 1, closing.c_str(), closing.size()));
+  const char *cur = found ? found + closing.size() : end;
+
+  add_multiline_token(state, STRING_GROUP, begin, cur);
+  return cur;
+}
+
+static const char *scan_number(scan_state &state, const char *cur) {
+  const char *begin = cur;
+  const char *end   = state.end;
+
+  bool hex = cur + 1 < end && cur[0] == '0' && (cur[1] == 'x' || cur[1] == 'X');
+  bool floating = false;
+
+  while (cur < end) {
+    char c = *cur;
+    if (c == '.') {
+      floating = true;
+    } else if ((hex && (c == 'p' || c == 'P')) ||
+               (hex == false && (c == 'e' || c == 'E'))) {
+      floating = true;
+      if (cur + 1 < end && (cur[1] == '+' || cur[1] == '-')) {
+        ++cur;
+      }
+    } else if (c == '\'' && cur + 1 < end && has_class(cur[1], CHAR_DIGIT)) {
+      // digit separator
+    } else if (has_class(c, CHAR_DIGIT | CHAR_IDENT) == false) {
+      break;
+    }
+    ++cur;
+  }
+
+  add_token(state, floating ? FLOATING_GROUP : INTEGER_GROUP, begin, cur);
+  return cur;
+}
+
+static const char *scan_directive(scan_state &state, const char *cur) {
+  const char *begin = cur;
+  const char *end   = state.end;
+
+  ++cur;
+  while (cur < end && has_class(*cur, CHAR_SPACE)) {
+    ++cur;
+  }
+
+  const char *name = cur;
+  while (cur < end && has_class(*cur, CHAR_IDENT | CHAR_DIGIT)) {
+    ++cur;
+  }
+
+  if (equal(name, cur, "define")) {
+    state.directive = DirectiveDefine;
+  } else if (equal(name, cur, "include") || equal(name, cur, "include_next") ||
+             equal(name, cur, "import")) {
+    state.directive = DirectiveInclude;
+  } else {
+    state.directive = DirectiveOther;
+  }
+
+  add_token(state, DIRECTIVE_GROUP, begin, cur);
+  state.previous = PreviousOther;
+  return cur;
+}
+
+static const char *scan_identifier(scan_state &state, const char *cur) {
+  const char *begin = cur;
+  const char *end   = state.end;
+
+  while (cur < end && has_class(*cur, CHAR_IDENT | CHAR_DIGIT)) {
+    ++cur;
+  }
+
+  // string and character literals with encoding prefix
+  if (cur < end && (*cur == '"' || *cur == '\'')) {
+    if (*cur == '"' &&
+        (equal(begin, cur, "R") || equal(begin, cur, "LR") ||
+         equal(begin, cur, "uR") || equal(begin, cur, "UR") ||
+         equal(begin, cur, "u8R"))) {
+      state.previous = PreviousOther;
+      return scan_raw_string(state, begin, cur);
+    } else if (equal(begin, cur, "L") || equal(begin, cur, "u") ||
+               equal(begin, cur, "U") || equal(begin, cur, "u8")) {
+      state.previous = PreviousOther;
+      return scan_quoted(state,
+                         *cur == '"' ? STRING_GROUP : CHARACTER_GROUP,
+                         begin,
+                         cur);
+    }
+  }
+
+  previous_kind previous = state.previous;
+  state.previous         = PreviousOther;
+
+  if (state.directive == DirectiveDefine) {
+    state.directive = DirectiveOther;
+    add_token(state, MACRO_DEFINITION_GROUP, begin, cur);
+    return cur;
+  }
+
+  if (is_keyword(begin, cur)) {
+    if (equal(begin, cur, "namespace")) {
+      state.previous = PreviousNamespace;
+    } else if (previous == PreviousEnum) {
+      // enum class
+      state.previous = PreviousEnum;
+    } else if (equal(begin, cur, "struct")) {
+      state.previous = PreviousStruct;
+    } else if (equal(begin, cur, "class")) {
+      state.previous = PreviousClass;
+    } else if (equal(begin, cur, "union")) {
+      state.previous = PreviousUnion;
+    } else if (equal(begin, cur, "enum")) {
+      state.previous = PreviousEnum;
+    }
+
+    add_token(state, KEYWORD_GROUP, begin, cur);
+    return cur;
+  }
+
+  const char *next      = skip_spaces(cur, end);
+  char        next_char = next < end ? *next : '\0';
+
+  const char *group = nullptr;
+  switch (previous) {
+  case PreviousMember:
+    group = MEMBER_GROUP;
+    break;
+  case PreviousNamespace:
+    group = NAMESPACE_GROUP;
+    break;
+  case PreviousStruct:
+  case PreviousClass:
+  case PreviousUnion:
+  case PreviousEnum: {
+    // declaration if after the name goes body, base list or semicolon
+    bool declaration =
+        next_char == '{' || next_char == ';' ||
+        (next_char == ':' && (next + 1 >= end || next[1] != ':'));
+    if (declaration == false) {
+      group = TYPE_GROUP;
+    } else if (previous == PreviousStruct) {
+      group = "StructDecl";
+    } else if (previous == PreviousClass) {
+      group = "ClassDecl";
+    } else if (previous == PreviousUnion) {
+      group = "UnionDecl";
+    } else {
+      group = "EnumDecl";
+    }
+  } break;
+  default:
+    if (is_macro_like(begin, cur)) {
+      group = MACRO_EXPANSION_GROUP;
+    } else if (next_char == '(') {
+      group = FUNCTION_GROUP;
+    }
+    break;
+  }
+
+  if (group != nullptr) {
+    add_token(state, group, begin, cur);
+  }
+  return cur;
+}
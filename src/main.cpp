@@ -1,52 +1,95 @@
+#include "async_log.hpp"
+#include "batch_tracker.hpp"
 #include "c_arg_parser/arg_parser.h"
 #include "c_logs/log.h"
-#include "clang_tokenize.hpp"
+#include "config.hpp"
 #include "gen/version.h"
-#include "rr_schemes.h"
-#include "token.hpp"
+#include "header_watcher.hpp"
+#include "process.hpp"
+#include "request_head.hpp"
+#include "return_code.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <atomic>
+#include <cassert>
+#include <cinttypes>
+#include <climits>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
-#include <exception>
-#include <list>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
 #include <netinet/in.h>
-#include <netinet/tcp.h>
-#include <nlohmann/json-schema.hpp>
-#include <nlohmann/json.hpp>
 #include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
-#ifdef GO_TOKENIZER
-#  include "gotokenizer.h"
-#endif
-
 #define ADDRESS   "localhost"
 #define BACKLOG   SOMAXCONN
 #define BUF_SIZE  1024 * 1024 // 1Mb
 #define DELIMITER '\n'
 
+#define DOCUMENTS_MAX_BYTES 256 * 1024 * 1024 // 256Mb
+#define POLL_TIMEOUT_MS     1000
+#define BATCH_WINDOW        32 // queued or started items of one batch
+
+#define CONTROL_RELOAD "reload"
+
 
 std::atomic_bool done{false};
+std::atomic_bool reload{false};
 static void      signal_handler(int val);
-
-static std::string
-process(const char *data, int default_flags_count, const char *default_flags[]);
+static void      reload_handler(int val);
 
 
 struct connection {
+  uint64_t    id;
   int         sock;
   sockaddr_in addr;
+  bool        broken;
   size_t      offset;
   char        buf[BUF_SIZE];
+  std::string output; // not written responses
+  size_t      output_offset;
+
+  // reading of the first byte of not complete message, for tracing
+  hl::trace::clock::time_point message_start;
 };
 
+static connection *find_connection(std::vector<connection> &connections,
+                                   uint64_t                 id);
+static bool        send_response(connection &con, std::string response);
+static bool        flush(connection &con);
+static bool
+add_specs(arg_parser *                                            parser,
+          const char *                                            option,
+          const std::function<bool(const char *, std::string &)> &add);
+static void set_verbose(bool verbose);
+static std::shared_ptr<const hl::process_settings>
+make_settings(const hl::server_config &config);
+
+/**\brief read config file and apply it
+ * \param scheduler, executor can be null in worker process
+ */
+static bool reload_config(const char *             path,
+                          const hl::server_config &cli_config,
+                          hl::process_context &    context,
+                          hl::scheduler *          scheduler,
+                          hl::executor *           executor,
+                          std::string &            err);
+
 
 int main(int argc, char *argv[]) {
   signal(SIGINT, signal_handler);
   signal(SIGTERM, signal_handler);
+  signal(SIGHUP, reload_handler);
 
 #ifdef LOGGER_ADD_SYSLOG_SINK
   const char *program_name = strrchr(argv[0], '/');
@@ -69,20 +112,164 @@ int main(int argc, char *argv[]) {
                        'v',
                        "print more logs to stderr",
                        false);
+  ARG_PARSER_ADD_INTD(parser,
+                      "async-log",
+                      0,
+                      "size of queue for asynchronous logging in records, 0 - "
+                      "synchronous logging",
+                      0);
+  ARG_PARSER_ADD_INTD(parser,
+                      "log-rate",
+                      0,
+                      "max count of the same log records per second in "
+                      "asynchronous logging, 0 - no limit",
+                      10);
+  ARG_PARSER_ADD_STR(parser,
+                     "config",
+                     0,
+                     "json file with settings, which override command line "
+                     "and are reloaded on SIGHUP: flag, verbose, "
+                     "max-inflight, max-queued, max-queue-cost, "
+                     "compress-threshold",
+                     false);
   ARG_PARSER_ADD_INTD(parser, "port", 'p', "port for listener", 53827);
   ARG_PARSER_ADD_STR(parser, "root", 0, "set root direcotry", false);
   ARG_PARSER_ADD_STR(parser, "flag", 0, "default compilation flags", false);
-
-
-  char *       err           = nullptr;
-  int          result        = 0;
-  bool         need_help     = false;
-  bool         need_version  = false;
-  bool         need_verbose  = false;
-  int          port          = 0;
-  const char * root          = NULL;
-  int          flag_count    = 0;
-  const char **default_flags = NULL;
+  ARG_PARSER_ADD_INTD(parser,
+                      "workers",
+                      0,
+                      "count of forked tokenizer processes, 0 - tokenize in "
+                      "the server process",
+                      0);
+  ARG_PARSER_ADD_INTD(parser,
+                      "threads",
+                      0,
+                      "count of tokenizer threads, if workers are not used",
+                      1);
+  ARG_PARSER_ADD_INTD(parser,
+                      "cache-size",
+                      0,
+                      "size of tokens cache in Mb, 0 - without cache",
+                      64);
+  ARG_PARSER_ADD_STR(parser,
+                     "profile",
+                     0,
+                     "parse profile NAME:OPTION,OPTION,... (options: "
+                     "detailed-preprocessing-record, incomplete, "
+                     "skip-function-bodies, keep-going, "
+                     "limit-skip-function-bodies-to-preamble, downgrade=NAME)",
+                     false);
+  ARG_PARSER_ADD_STR(parser,
+                     "profile-glob",
+                     0,
+                     "use parse profile for buffers matched by glob GLOB:NAME",
+                     false);
+  ARG_PARSER_ADD_INTD(parser,
+                      "downgrade-size",
+                      0,
+                      "buffers bigger then this size in Kb are parsed with "
+                      "downgrade profile, 0 - no limit",
+                      0);
+  ARG_PARSER_ADD_INTD(parser,
+                      "downgrade-time",
+                      0,
+                      "buffers parsed longer then this time in ms are parsed "
+                      "with downgrade profile next time, 0 - no limit",
+                      0);
+  ARG_PARSER_ADD_STR(parser,
+                     "store",
+                     0,
+                     "file for persistent tokens store, every worker uses "
+                     "own file with index suffix",
+                     false);
+  ARG_PARSER_ADD_INTD(parser,
+                      "store-size",
+                      0,
+                      "size of tokens store file in Mb, after which it is "
+                      "compacted",
+                      512);
+  ARG_PARSER_ADD_INTD(parser,
+                      "compress-threshold",
+                      0,
+                      "responses bigger then this size in Kb are compressed, "
+                      "if client requested it, 0 - without compression",
+                      64);
+  ARG_PARSER_ADD_INTD(parser,
+                      "watch-buffers",
+                      0,
+                      "count of recently tokenized buffers, which are "
+                      "tokenized again after changing of their headers, 0 - "
+                      "don't watch headers",
+                      64);
+  ARG_PARSER_ADD_INTD(parser,
+                      "max-inflight",
+                      0,
+                      "max count of requests from one connection, which are "
+                      "tokenized at the same time",
+                      4);
+  ARG_PARSER_ADD_INTD(parser,
+                      "max-queued",
+                      0,
+                      "max count of not started requests from one "
+                      "connection, 0 - no limit",
+                      64);
+  ARG_PARSER_ADD_INTD(parser,
+                      "max-queue-cost",
+                      0,
+                      "max summary cost (size of buffers and parsed headers) "
+                      "of not started requests in Mb, 0 - no limit",
+                      256);
+  ARG_PARSER_ADD_STR(parser,
+                     "allow-paths",
+                     0,
+                     "directory, from which buffers can be read by buf_path "
+                     "and batch items without buf_body",
+                     false);
+  ARG_PARSER_ADD_STR(parser,
+                     "trace-file",
+                     0,
+                     "write phases of requests to the file in Chrome "
+                     "trace-event format",
+                     false);
+  ARG_PARSER_ADD_INTD(parser,
+                      "trace-sample",
+                      0,
+                      "trace one of N requests",
+                      1);
+
+
+  char *       err            = nullptr;
+  int          result         = 0;
+  bool         need_help      = false;
+  bool         need_version   = false;
+  bool         need_verbose   = false;
+  int          port           = 0;
+  int          async_log_size = 0;
+  int          log_rate       = 0;
+  const char * root           = NULL;
+  int          flag_count     = 0;
+  const char **default_flags  = NULL;
+  int          worker_count   = 0;
+  int          thread_count   = 0;
+  int          max_inflight   = 0;
+  int          max_queued     = 0;
+  int          max_queue_cost = 0;
+  int          cache_size     = 0;
+  int          downgrade_size = 0;
+  int          downgrade_time = 0;
+  int          compress_size  = 0;
+  const char * store_path     = NULL;
+  int          store_size     = 0;
+  int          watch_buffers  = 0;
+  const char * config_path    = NULL;
+  const char * trace_path     = NULL;
+  const char * allow_paths    = NULL;
+  char         allowed_dir[PATH_MAX];
+  int          trace_sample   = 0;
+
+  hl::server_config cli_config; // without values from config file
+  hl::server_config config;
+  std::string       config_err;
 
   int         acceptor = -1;
   sockaddr_in addr;
@@ -90,6 +277,22 @@ int main(int argc, char *argv[]) {
 
   std::vector<pollfd>     socks;
   std::vector<connection> connections;
+  uint64_t                connection_counter = 0;
+
+  hl::document_store  documents{DOCUMENTS_MAX_BYTES};
+  std::unique_ptr<hl::response_cache> cache;
+  std::unique_ptr<hl::parse_profiles> profiles;
+  std::unique_ptr<hl::token_store>    store;
+  std::unique_ptr<hl::header_watcher> watcher;
+  hl::process_context                 context{
+      nullptr, &documents, nullptr, nullptr, nullptr, false, c_version, ""};
+
+  std::unique_ptr<hl::executor>  executor;
+  std::unique_ptr<hl::scheduler> scheduler;
+  hl::batch_tracker              batches{BATCH_WINDOW};
+
+  // tags of started requests, which are traced, by tag
+  std::unordered_map<uint64_t, hl::trace::tags> traced;
 
 
   result = ARG_PARSER_PARSE(parser, argc, argv, false, false, &err);
@@ -106,9 +309,16 @@ int main(int argc, char *argv[]) {
   }
 
   ARG_PARSER_GET_BOOL(parser, "verbose", need_verbose);
-  if (need_verbose) {
-    LOGGER_ADD_STDERR_SINK(log_default_format, LogDebug | LogTrace);
-    LOG_INFO("verbose logging is on");
+  set_verbose(need_verbose);
+
+  // the io loop isn't blocked by slow sinks
+  ARG_PARSER_GET_INT(parser, "async-log", async_log_size);
+  ARG_PARSER_GET_INT(parser, "log-rate", log_rate);
+  if (async_log_size > 0 &&
+      hl::async_log::start(async_log_size, std::max(log_rate, 0))) {
+    LOG_INFO("uses asynchronous logging: %d records, %d per second",
+             async_log_size,
+             log_rate);
   }
 
   ARG_PARSER_GET_INT(parser, "port", port);
@@ -141,6 +351,51 @@ int main(int argc, char *argv[]) {
   }
   LOG_DEBUG("flags parsed")
 
+  ARG_PARSER_GET_INT(parser, "compress-threshold", compress_size);
+  ARG_PARSER_GET_INT(parser, "max-inflight", max_inflight);
+  ARG_PARSER_GET_INT(parser, "max-queued", max_queued);
+  ARG_PARSER_GET_INT(parser, "max-queue-cost", max_queue_cost);
+
+  cli_config.default_flags.assign(default_flags, default_flags + flag_count);
+  cli_config.verbose            = need_verbose;
+  cli_config.max_inflight       = max_inflight;
+  cli_config.max_queued         = max_queued;
+  cli_config.max_queue_cost     = max_queue_cost;
+  cli_config.compress_threshold = compress_size;
+  config                        = cli_config;
+
+  // XXX the config is read after changing of root, so reloading reads the
+  // same file
+  if (ARG_PARSER_GET_STR(parser, "config", config_path) == 1) {
+    LOG_INFO("uses config: %s", config_path);
+    if (hl::read_config(config_path, config, config_err) == false) {
+      LOG_ERROR("invalid config %s: %s", config_path, config_err.c_str());
+      goto Failure;
+    }
+    set_verbose(config.verbose);
+  }
+
+  LOG_DEBUG("parsing profiles")
+  ARG_PARSER_GET_INT(parser, "downgrade-size", downgrade_size);
+  ARG_PARSER_GET_INT(parser, "downgrade-time", downgrade_time);
+  profiles.reset(
+      new hl::parse_profiles(size_t(std::max(downgrade_size, 0)) * 1024,
+                             std::max(downgrade_time, 0)));
+  if (add_specs(parser,
+                "profile",
+                [&profiles](const char *spec, std::string &spec_err) {
+                  return profiles->add_profile(spec, spec_err);
+                }) == false ||
+      add_specs(parser,
+                "profile-glob",
+                [&profiles](const char *spec, std::string &spec_err) {
+                  return profiles->add_glob(spec, spec_err);
+                }) == false) {
+    goto Failure;
+  }
+  context.profiles = profiles.get();
+  LOG_DEBUG("profiles parsed")
+
 
   // resolve address
   LOG_DEBUG("address resolving")
@@ -189,6 +444,153 @@ int main(int argc, char *argv[]) {
   }
 
 
+  context.settings = make_settings(config);
+
+  ARG_PARSER_GET_INT(parser, "cache-size", cache_size);
+  if (cache_size > 0) {
+    LOG_INFO("uses tokens cache: %dMb", cache_size);
+    cache.reset(new hl::response_cache(size_t(cache_size) * 1024 * 1024));
+    context.cache = cache.get();
+  }
+
+  if (config.compress_threshold > 0) {
+    LOG_INFO("compress responses bigger then: %dKb", config.compress_threshold);
+  }
+
+  ARG_PARSER_GET_STR(parser, "store", store_path);
+  ARG_PARSER_GET_INT(parser, "store-size", store_size);
+  if (store_path != NULL) {
+    if (store_size <= 0) {
+      LOG_ERROR("invalid size of tokens store: %d", store_size);
+      goto Failure;
+    }
+    LOG_INFO("uses tokens store: %s, %dMb", store_path, store_size);
+  }
+
+  // XXX paths are resolved after changing of root
+  if (ARG_PARSER_GET_STR(parser, "allow-paths", allow_paths) == 1) {
+    if (realpath(allow_paths, allowed_dir) == nullptr) {
+      LOG_ERROR("invalid directory for reading of buffers %s: %s",
+                allow_paths,
+                strerror(errno));
+      goto Failure;
+    }
+    context.allowed_dir = allowed_dir;
+    LOG_INFO("buffers can be read from: %s", allowed_dir);
+  }
+
+  ARG_PARSER_GET_STR(parser, "trace-file", trace_path);
+  ARG_PARSER_GET_INT(parser, "trace-sample", trace_sample);
+  if (trace_path != NULL) {
+    if (trace_sample <= 0) {
+      LOG_ERROR("invalid trace sample: %d", trace_sample);
+      goto Failure;
+    }
+    if (hl::trace::start(trace_path, trace_sample) == false) {
+      goto Failure;
+    }
+    LOG_INFO("trace one of %d requests to: %s", trace_sample, trace_path);
+  }
+
+  ARG_PARSER_GET_INT(parser, "watch-buffers", watch_buffers);
+  if (watch_buffers > 0) {
+    watcher.reset(new hl::header_watcher(watch_buffers));
+    if (watcher->start()) {
+      LOG_INFO("watch headers of buffers: %d", watch_buffers);
+      context.watch_headers = true;
+    } else {
+      watcher.reset();
+    }
+  }
+
+  ARG_PARSER_GET_INT(parser, "workers", worker_count);
+  ARG_PARSER_GET_INT(parser, "threads", thread_count);
+  if (worker_count > 0) {
+    LOG_INFO("uses workers: %d", worker_count);
+
+    executor.reset(new hl::worker_pool(
+        worker_count,
+        [&context, &cli_config, config_path](
+            const char *                      data,
+            const hl::executor::partial_type &partial,
+            hl::executor::dependencies &      deps) {
+          // SIGHUP is forwarded to workers by supervisor
+          std::string reload_err;
+          if (reload.exchange(false)) {
+            reload_config(config_path,
+                          cli_config,
+                          context,
+                          nullptr,
+                          nullptr,
+                          reload_err);
+          }
+
+          return hl::process(data, context, partial, deps);
+        },
+        [&acceptor,
+         &connections,
+         &watcher,
+         &context,
+         &store,
+         store_path,
+         store_size](size_t index) {
+          close(acceptor);
+          for (const connection &con : connections) {
+            close(con.sock);
+          }
+          watcher.reset();
+          hl::async_log::reset_after_fork();
+          hl::trace::reset_after_fork();
+
+          // the file can't be shared by processes, but every buffer is
+          // always routed to the same worker
+          if (store_path != NULL) {
+            store.reset(new hl::token_store(std::string{store_path} + '.' +
+                                                std::to_string(index),
+                                            size_t(store_size) * 1024 * 1024));
+            context.store = store->open() ? store.get() : nullptr;
+          }
+        }));
+  } else {
+    LOG_INFO("uses threads: %d", thread_count);
+
+    if (store_path != NULL) {
+      store.reset(new hl::token_store(store_path,
+                                      size_t(store_size) * 1024 * 1024));
+      if (store->open() == false) {
+        goto Failure;
+      }
+      context.store = store.get();
+    }
+
+    executor.reset(new hl::thread_pool(
+        std::max(thread_count, 1),
+        [&context](const char *                       data,
+                   const hl::executor::partial_type &partial,
+                   hl::executor::dependencies &      deps) {
+          return hl::process(data, context, partial, deps);
+        }));
+  }
+  if (executor->start() == false) {
+    LOG_ERROR("can't start executor");
+    goto Failure;
+  }
+
+  // every thread or worker gets items of a batch without waiting for the io
+  // loop
+  batches.set_window(std::max<size_t>(
+      BATCH_WINDOW, 2 * size_t(std::max({worker_count, thread_count, 1}))));
+
+  LOG_INFO("uses max inflight requests per connection: %d",
+           config.max_inflight);
+  LOG_INFO("uses max queued requests per connection: %d", config.max_queued);
+  LOG_INFO("uses max queue cost: %dMb", config.max_queue_cost);
+  scheduler.reset(new hl::scheduler(
+      std::max(config.max_inflight, 1),
+      std::max(config.max_queued, 0),
+      size_t(std::max(config.max_queue_cost, 0)) * 1024 * 1024));
+
+
   socks.reserve(8);
   connections.reserve(8);
 
@@ -211,15 +613,48 @@ int main(int argc, char *argv[]) {
       pfd.fd      = con.sock;
       pfd.events  = POLLIN | POLLPRI | POLLRDHUP | POLLHUP | POLLERR;
       pfd.revents = 0;
+      if (con.output.size() != con.output_offset) {
+        pfd.events |= POLLOUT;
+      }
       socks.push_back(pfd);
     }
 
+    // XXX descriptors of executor are placed after connections, watcher is
+    // the last one
+    const size_t connections_end = socks.size();
+    executor->add_pollfds(socks);
+
+    int timeout = POLL_TIMEOUT_MS;
+    if (watcher) {
+      pfd.fd      = watcher->fd();
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+      socks.push_back(pfd);
+
+      // changed headers are handled after delay
+      if (watcher->timeout_ms() >= 0) {
+        timeout = std::min(timeout, watcher->timeout_ms());
+      }
+    }
+
 
-    result = poll(socks.data(), socks.size(), 1000 /*1sec*/);
+    result = poll(socks.data(), socks.size(), timeout);
+
+    // new settings are used by requests, which are started after reloading
+    if (reload.exchange(false)) {
+      reload_config(config_path,
+                    cli_config,
+                    context,
+                    scheduler.get(),
+                    executor.get(),
+                    config_err);
+    }
 
     if (result < 0) {
-      LOG_ERROR("poll error: %s", strerror(errno));
-    } else if (result == 0) {
+      if (errno != EINTR) {
+        LOG_ERROR("poll error: %s", strerror(errno));
+      }
+    } else if (result == 0 && timeout == POLL_TIMEOUT_MS) {
       continue;
     }
 
@@ -242,16 +677,22 @@ int main(int argc, char *argv[]) {
         goto SkipAccepting;
       }
 
+      // responses are written by parts, when socket is ready
+      fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
       // append connection
-      connections.emplace_back(connection{sock, addr, 0, ""});
+      connections.emplace_back(connection{});
+      connections.back().id   = ++connection_counter;
+      connections.back().sock = sock;
+      connections.back().addr = addr;
 
-      LOG_INFO("accepted connection from %d", ntohs(addr.sin_port));
+      ALOG_INFO("accepted connection from %d", ntohs(addr.sin_port));
     }
   SkipAccepting:
 
 
-    // socket reading
-    for (size_t i = 1; i < socks.size(); ++i) {
+    // socket reading and writing
+    for (size_t i = 1; i < connections_end; ++i) {
       assert(i - 1 < connections.size());
 
       connection &con      = connections[i - 1];
@@ -260,118 +701,378 @@ int main(int argc, char *argv[]) {
       if (socks[i].revents == 0) {
         continue;
       } else if (socks[i].revents & (POLLRDHUP | POLLHUP)) {
-        // remove later
-        LOG_INFO("connection broken from %d", con_port);
+        ALOG_INFO("connection broken from %d", con_port);
+        con.broken = true; // remove later
         continue;
       } else if (socks[i].revents & POLLERR) {
-        // remove later
         LOG_ERROR("unexpected connection error from %d", con_port);
+        con.broken = true; // remove later
         continue;
       }
-      // otherwise we have data for reading
 
-      socks[i].revents = 0;
+      if (socks[i].revents & POLLOUT) {
+        if (flush(con) == false) {
+          con.broken = true; // remove later
+          continue;
+        }
+      }
+
+      if ((socks[i].revents & (POLLIN | POLLPRI)) == 0) {
+        continue;
+      }
+      // otherwise we have data for reading
 
 
       int count =
           read(con.sock, con.buf + con.offset, sizeof(con.buf) - con.offset);
       if (count < 0) {
-        // remove later
-        socks[i].revents = POLLERR;
-        LOG_ERROR("reading error from %d: %s", con_port, strerror(errno))
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          LOG_ERROR("reading error from %d: %s", con_port, strerror(errno))
+          con.broken = true; // remove later
+        }
         continue;
       } else if (count == 0) {
-        // remove later
-        socks[i].revents = POLLERR;
+        con.broken = true; // remove later
         continue;
       }
 
-      LOG_DEBUG("readen from %d: %.1fKb", con_port, count / 1024.);
+      ALOG_DEBUG("readen from %d: %.1fKb", con_port, count / 1024.);
+
+      // a big message is gathered by several reads
+      hl::trace::clock::time_point read_time = hl::trace::clock::now();
+      if (con.offset == 0) {
+        con.message_start = read_time;
+      }
 
       con.offset += count;
-      if (con.buf[con.offset - 1] != DELIMITER) {
-        LOG_DEBUG("readen not enough data");
-
-        char *found = strrchr(con.buf, DELIMITER);
-        if (found) {
-          LOG_DEBUG("ignore old data: %.1fKb",
-                    std::distance(con.buf, found) / 1024.);
-          strcpy(con.buf, found);
-          con.offset = strlen(con.buf);
-        } else if (con.offset >= sizeof(con.buf)) {
-          LOG_WARNING("too big data, can't store in internal buffer, skip it");
-          con.offset = 0;
+
+
+      // every complete message is separated request
+      char *begin = con.buf;
+      char *end   = con.buf + con.offset;
+      char *found = nullptr;
+      while ((found = (char *)memchr(begin, DELIMITER, end - begin)) !=
+             nullptr) {
+        hl::request_head head;
+        if (found == begin) {
+          // empty message
+        } else if (hl::peek_request_head(begin, found - begin, head) ==
+                   false) {
+          // XXX such request can't be decoded by process() too, so it is not
+          // queued and not answered
+          ALOG_WARNING("invalid request from %d: %.1fKb, skip it",
+                       con_port,
+                       (found - begin) / 1024.);
+        } else {
+          if (hl::trace::enabled() &&
+              hl::trace::sampled(head.id, head.message_number)) {
+            hl::trace::complete("framing",
+                                con.message_start,
+                                hl::trace::clock::now(),
+                                hl::trace::tags{con.id,
+                                                head.id,
+                                                head.buf_name,
+                                                head.message_number,
+                                                size_t(found - begin),
+                                                0});
+          }
+
+          ALOG_DEBUG("request from %d for %s: %.1fKb",
+                     con_port,
+                     head.buf_name.c_str(),
+                     (found - begin) / 1024.);
+
+          // control requests are not queued
+          unsigned int retry_after_ms = 0;
+          if (head.control.empty() == false) {
+            int control_code = hl::Success;
+            config_err.clear();
+            if (head.control != CONTROL_RELOAD) {
+              control_code = hl::ControlFailed;
+              config_err   = "unknown control command: " + head.control;
+            } else if (reload_config(config_path,
+                                     cli_config,
+                                     context,
+                                     scheduler.get(),
+                                     executor.get(),
+                                     config_err) == false) {
+              control_code = hl::ControlFailed;
+            }
+
+            if (send_response(con,
+                              hl::make_error_response(head,
+                                                      control_code,
+                                                      config_err)) == false) {
+              con.broken = true; // remove later
+            }
+          } else if (head.batch) {
+            // items of batch are queued later by parts
+            std::string batch_err;
+            if (batches.add(con.id, head, begin, found - begin, batch_err) ==
+                    false &&
+                send_response(con,
+                              hl::make_error_response(
+                                  head,
+                                  hl::InvalidBatch,
+                                  "invalid batch: " + batch_err)) == false) {
+              con.broken = true; // remove later
+            }
+          } else if (scheduler->push(con.id,
+                                     head,
+                                     std::string(begin, found),
+                                     retry_after_ms) == false &&
+                     send_response(con,
+                            hl::make_error_response(
+                                head,
+                                hl::ServerBusy,
+                                "busy, retry after " +
+                                    std::to_string(retry_after_ms) + " ms")) ==
+                  false) {
+            con.broken = true; // remove later
+          }
         }
 
-        continue;
+        // the next message is started by this read
+        begin             = found + 1;
+        con.message_start = read_time;
       }
 
+      // keep not complete message
+      con.offset = end - begin;
+      memmove(con.buf, begin, con.offset);
 
-      // get latest data
-      char delim              = DELIMITER;
-      con.buf[con.offset - 1] = '\0'; // need for ignore latest delimiter
-      char *data              = strrchr(con.buf, DELIMITER);
-      data                    = data ? data : con.buf;
+      if (con.offset >= sizeof(con.buf)) {
+        ALOG_WARNING("too big data, can't store in internal buffer, skip it");
+        con.offset = 0;
+      } else if (con.offset != 0) {
+        ALOG_DEBUG("readen not enough data");
+      }
+    }
 
-      LOG_DEBUG_IF(con.buf != data,
-                   "ignore old data from %d: %.1fKb",
-                   con_port,
-                   std::distance(con.buf, data) / 1024.);
 
+    // clients wait for response for every message number
+    for (const hl::job &replaced : scheduler->take_replaced()) {
+      connection *con = find_connection(connections, replaced.client);
+      if (con != nullptr &&
+          send_response(*con,
+                        hl::make_error_response(
+                            replaced.head,
+                            hl::Superseded,
+                            "superseded by newer request for the buffer")) ==
+              false) {
+        con->broken = true; // remove later
+      }
+    }
 
-      // process
-      std::string response = process(data, flag_count, default_flags);
 
+    // responses from executor
+    for (hl::executor::completion &completion :
+         executor->handle_events(socks.data() + connections_end)) {
+      // request is still in work after partial response
+      uint64_t client = 0;
+      if ((completion.partial ? scheduler->client_of(completion.tag, client)
+                              : scheduler->finish(completion.tag, client)) ==
+          false) {
+        LOG_ERROR("unknown response from executor");
+        continue;
+      }
+      if (completion.partial == false) {
+        batches.finished(completion.tag,
+                         completion.lost || completion.data.empty());
+      }
 
-      // switch on cork option
-      int cork = 1;
-      setsockopt(con.sock, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+      // traced request is finished by writing of response
+      hl::trace::tags request_tags{};
+      bool            is_traced = false;
+      if (completion.partial == false) {
+        auto found = traced.find(completion.tag);
+        if (found != traced.end()) {
+          request_tags = std::move(found->second);
+          is_traced    = true;
+          traced.erase(found);
+        }
+      }
 
-      count = write(con.sock, response.c_str(), response.size());
-      if (count < 0) {
-        // remove later
-        socks[i].revents = POLLERR;
-        LOG_ERROR("failure during writting response to %d: %s",
-                  con_port,
-                  strerror(errno));
+      connection *con = find_connection(connections, client);
+      if (con == nullptr) {
+        ALOG_DEBUG("response for closed connection, ignore it");
         continue;
-      } else {
-        LOG_DEBUG("written: %.1fKb", count / 1024.);
       }
 
-      count = write(con.sock, &delim, 1);
-      if (count < 0) {
-        // remove later
-        socks[i].revents = POLLERR;
-        LOG_ERROR("failure during writing delimiter to %d: %s",
-                  con_port,
-                  strerror(errno));
+      if (watcher && completion.deps.files.empty() == false) {
+        hl::request_head head;
+        hl::peek_request_head(completion.deps.refresh_request.c_str(),
+                              completion.deps.refresh_request.size(),
+                              head);
+        watcher->watch(client,
+                       head.buf_name,
+                       completion.deps.files,
+                       std::move(completion.deps.refresh_request));
+      }
+
+      // refreshed buffer is not kept anymore
+      if (completion.data.empty()) {
+        ALOG_DEBUG("empty response, ignore it");
         continue;
       }
 
-      // switch off cork option
-      cork = 0;
-      setsockopt(con.sock, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+      if (completion.lost) {
+        hl::request_head head;
+        hl::peek_request_head(completion.data.c_str(),
+                              completion.data.size(),
+                              head);
+
+        LOG_ERROR("tokenizer crashed during handling %s",
+                  head.buf_name.c_str());
+
+        completion.data =
+            hl::make_error_response(head,
+                                    hl::TokenizerCrashed,
+                                    "tokenizer crashed during handling");
+      }
 
-      // clear buffer
-      con.offset = 0;
+      hl::trace::clock::time_point write_start = hl::trace::clock::now();
+      if (send_response(*con, std::move(completion.data)) == false) {
+        con->broken = true; // remove later
+      }
+      if (is_traced) {
+        hl::trace::complete("write",
+                            write_start,
+                            hl::trace::clock::now(),
+                            request_tags);
+      }
+    }
+
+
+    // buffers, which headers are changed, are tokenized again in background
+    if (watcher) {
+      if (socks.back().revents != 0) {
+        watcher->handle_events();
+      }
+
+      for (const hl::header_watcher::refresh &refresh :
+           watcher->take_refreshes()) {
+        if (find_connection(connections, refresh.client) == nullptr) {
+          continue;
+        }
+
+        hl::request_head head;
+        hl::peek_request_head(refresh.request.c_str(),
+                              refresh.request.size(),
+                              head);
+
+        unsigned int retry_after_ms = 0;
+        if (scheduler->push(refresh.client,
+                            head,
+                            refresh.request,
+                            retry_after_ms) == false) {
+          ALOG_WARNING("can't refresh %s, server is busy",
+                       head.buf_name.c_str());
+        }
+      }
+    }
+
+
+    // summaries are sent after responses for all items
+    for (hl::batch_tracker::summary &summary : batches.take_summaries()) {
+      connection *con = find_connection(connections, summary.client);
+      if (con != nullptr &&
+          send_response(*con, std::move(summary.response)) == false) {
+        con->broken = true; // remove later
+      }
+    }
+
+    batches.feed([&scheduler](uint64_t                client,
+                              const hl::request_head &head,
+                              std::string             data) {
+      unsigned int retry_after_ms = 0;
+      return scheduler->push(client, head, std::move(data), retry_after_ms);
+    });
+
+
+    // reject requests, which can't be started in time
+    hl::job job;
+    while (scheduler->pop_expired(job)) {
+      ALOG_WARNING("deadline expired for %s", job.head.buf_name.c_str());
+
+      connection *con = find_connection(connections, job.client);
+      if (con != nullptr &&
+          send_response(*con,
+                        hl::make_error_response(job.head,
+                                                hl::DeadlineExpired,
+                                                "deadline expired")) == false) {
+        con->broken = true; // remove later
+      }
+    }
+
+
+    // start queued requests
+    while (scheduler->pop(
+        [&executor](const hl::job &queued) {
+          return executor->ready(queued.head.buf_name);
+        },
+        job)) {
+      if (job.head.batch_item) {
+        batches.started(job.tag, job.client, job.head);
+      }
+
+      if (hl::trace::enabled() &&
+          hl::trace::sampled(job.head.id, job.head.message_number)) {
+        hl::trace::tags request_tags{job.client,
+                                     job.head.id,
+                                     job.head.buf_name,
+                                     job.head.message_number,
+                                     job.data.size(),
+                                     0};
+        hl::trace::complete("queue",
+                            job.received,
+                            hl::trace::clock::now(),
+                            request_tags);
+        traced[job.tag] = std::move(request_tags);
+      }
+
+      if (executor->send(job.tag, job.head.buf_name, std::move(job.data))) {
+        continue;
+      }
+
+      LOG_ERROR("tokenizer not available for %s", job.head.buf_name.c_str());
+
+      uint64_t client = 0;
+      scheduler->finish(job.tag, client);
+      batches.finished(job.tag, true);
+      traced.erase(job.tag);
+
+      connection *con = find_connection(connections, client);
+      if (con != nullptr &&
+          send_response(*con,
+                        hl::make_error_response(job.head,
+                                                hl::TokenizerCrashed,
+                                                "tokenizer not available")) ==
+              false) {
+        con->broken = true; // remove later
+      }
     }
 
 
     // remove all closed and error connections
-    size_t counter = 0;
-    auto   new_end = std::remove_if(
-        connections.begin(),
-        connections.end(),
-        [&counter, &socks](const connection &con) {
-          ++counter;
-          if (counter < socks.size() && socks[counter].revents != 0) {
-            LOG_INFO("closed connection from %d", ntohs(con.addr.sin_port));
-            close(con.sock);
-            return true;
-          }
-          return false;
-        });
+    auto new_end = std::remove_if(connections.begin(),
+                                  connections.end(),
+                                  [&scheduler,
+                                   &watcher,
+                                   &batches](const connection &con) {
+                                    if (con.broken) {
+                                      ALOG_INFO("closed connection from %d",
+                                                ntohs(con.addr.sin_port));
+                                      close(con.sock);
+                                      scheduler->remove_client(con.id);
+                                      batches.remove_client(con.id);
+                                      if (watcher) {
+                                        watcher->remove_client(con.id);
+                                      }
+                                      return true;
+                                    }
+                                    return false;
+                                  });
     connections.erase(new_end, connections.end());
   }
 
@@ -379,6 +1080,18 @@ int main(int argc, char *argv[]) {
   // finish
   signal(SIGINT, SIG_DFL);
   signal(SIGTERM, SIG_DFL);
+  signal(SIGHUP, SIG_DFL);
+
+  executor.reset();
+  hl::trace::stop();
+
+  if (cache && worker_count <= 0) {
+    LOG_INFO("tokens cache hits: %" PRIu64 ", misses: %" PRIu64,
+             cache->hits(),
+             cache->misses());
+  }
+  LOG_INFO("rejected requests because of overload: %" PRIu64,
+           scheduler->rejected());
 
 
   for (connection &con : connections) {
@@ -393,6 +1106,8 @@ int main(int argc, char *argv[]) {
 
   arg_parser_dispose(parser);
 
+  hl::async_log::stop();
+
   LOG_INFO("finish");
   LOGGER_SHUTDOWN();
   return EXIT_SUCCESS;
@@ -412,6 +1127,9 @@ Failure:
     delete[] default_flags;
   }
   arg_parser_dispose(parser);
+  executor.reset();
+  hl::trace::stop();
+  hl::async_log::stop();
   LOGGER_SHUTDOWN();
   return EXIT_FAILURE;
 
@@ -443,215 +1161,145 @@ static void signal_handler(int) {
   done = true;
 }
 
-static std::list<std::string> split(const std::string &str) {
-  std::list<std::string> retval;
-
-  const char *start = str.c_str();
-  do {
-    const char *found = strchr(start, DELIMITER);
-    if (found) {
-      retval.emplace_back(start, found++);
-    } else {
-      retval.emplace_back(start);
-    }
-
-    start = found;
-  } while (start);
-
-  return retval;
+static void reload_handler(int) {
+  reload = true;
 }
 
-static std::vector<const char *>
-to_argv(const std::list<std::string> &string_list) {
-  std::vector<const char *> retval;
-  retval.reserve(string_list.size());
+static connection *find_connection(std::vector<connection> &connections,
+                                   uint64_t                 id) {
+  auto found = std::find_if(connections.begin(),
+                            connections.end(),
+                            [id](const connection &con) {
+                              return con.id == id;
+                            });
+  return found != connections.end() ? &*found : nullptr;
+}
 
-  for (const std::string &str : string_list) {
-    retval.emplace_back(str.c_str());
+static bool send_response(connection &con, std::string response) {
+  // avoid copying if there is no not written responses
+  if (con.output.empty()) {
+    con.output = std::move(response);
+  } else {
+    con.output += response;
   }
+  con.output += DELIMITER;
 
-  return retval;
+  return flush(con);
 }
 
-#define VERSION_TAG         "version"
-#define ID_TAG              "id"
-#define BUF_TYPE_TAG        "buf_type"
-#define BUF_NAME_TAG        "buf_name"
-#define BUF_BODY_TAG        "buf_body"
-#define ADDITIONAL_INFO_TAG "additional_info"
-#define RETURN_CODE_TAG     "return_code"
-#define ERROR_MESSAGE_TAG   "error_message"
-#define TOKENS_TAG          "tokens"
-
-static std::string process(const char *data,
-                           int         default_flags_count,
-                           const char *default_flags[]) {
-  using nlohmann::json;
-  using nlohmann::json_schema::json_validator;
-
-  int         message_number = -1;
-  std::string version;
-  std::string id;
-  std::string buf_type;
-  std::string buf_name;
-  std::string buf_body;
-  std::string additional_info;
-
-  json jresponse;
-
-  char        filename[] = ".hl-server-tmp-file-XXXXXX";
-  int         fd         = -1;
-  int         written    = 0;
-  std::string err;
-
-  std::list<std::string>    args;
-  std::vector<const char *> argv;
-  hl::token_list            tokens;
-
-
-  try {
-    static json schema = json::parse(request_schema_v11);
-
-
-    json_validator validator;
-    validator.set_root_schema(schema);
-
-    json jdata = json::parse(data);
-    validator.validate(jdata);
-
-    message_number  = jdata[0];
-    version         = jdata[1][VERSION_TAG];
-    id              = jdata[1][ID_TAG];
-    buf_type        = jdata[1][BUF_TYPE_TAG];
-    buf_name        = jdata[1][BUF_NAME_TAG];
-    buf_body        = jdata[1][BUF_BODY_TAG];
-    additional_info = jdata[1][ADDITIONAL_INFO_TAG];
-  } catch (std::exception &e) {
-    LOG_ERROR("json handling error: %s", e.what());
-    return "";
-  }
-
-  jresponse[0]               = message_number;
-  jresponse[1][VERSION_TAG]  = version;
-  jresponse[1][ID_TAG]       = id;
-  jresponse[1][BUF_TYPE_TAG] = buf_type;
-  jresponse[1][BUF_NAME_TAG] = buf_name;
-  jresponse[1][TOKENS_TAG]   = json::object(); // placeholder
-
-
-  if (buf_type == "cpp" || buf_type == "c") {
-    // create tmp file
-    fd = mkstemp(filename);
-    if (fd < 0) {
-      LOG_ERROR("can't open temporary file: %s", strerror(errno));
-
-      jresponse[1][RETURN_CODE_TAG]   = 2;
-      jresponse[1][ERROR_MESSAGE_TAG] = "can't open temporary file for buffer";
-      goto Finish;
-    }
-
-    written = write(fd, buf_body.c_str(), buf_body.size());
-    if (written < 0) {
-      LOG_ERROR("can't write buffer to temporary file: %s", strerror(errno));
-
-      jresponse[1][RETURN_CODE_TAG]   = 3;
-      jresponse[1][ERROR_MESSAGE_TAG] = "can't write buffer to temporary file";
-      goto Finish;
-    }
+static bool flush(connection &con) {
+  int con_port = ntohs(con.addr.sin_port);
 
+  while (con.output_offset < con.output.size()) {
+    ssize_t count = send(con.sock,
+                         con.output.c_str() + con.output_offset,
+                         con.output.size() - con.output_offset,
+                         MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // rest will be written when socket will be ready
+        return true;
+      }
 
-    // tokenization
-    args = split(additional_info);
-    argv = to_argv(args);
-    for (int i = 0; i < default_flags_count; ++i) {
-      argv.push_back(default_flags[i]);
+      LOG_ERROR("failure during writting response to %d: %s",
+                con_port,
+                strerror(errno));
+      return false;
     }
 
-    tokens = hl::clang_tokenize(filename, argv.size(), argv.data(), err);
-    if (err.empty() == false) {
-      LOG_ERROR("error from c/cpp tokenizer: %s", err.c_str());
-
-      jresponse[1][RETURN_CODE_TAG]   = 4;
-      jresponse[1][ERROR_MESSAGE_TAG] = "error from tokenizer: " + err;
-      goto Finish;
-    }
+    ALOG_DEBUG("written to %d: %.1fKb", con_port, count / 1024.);
+    con.output_offset += count;
+  }
 
-    for (const hl::token &token : tokens) {
-      jresponse[1][TOKENS_TAG][token.group].emplace_back(token.pos);
-    }
-#ifdef GO_TOKENIZER
-  } else if (buf_type == "go") {
-    char *out  = NULL;
-    char *msg  = NULL;
-    int   code = 0;
-
-    code = go_tokenize((char *)buf_name.c_str(),
-                       (char *)buf_body.c_str(),
-                       &out,
-                       &msg);
-
-    if (code != 0) {
-      LOG_ERROR("error from go tokenizer: %s", msg)
-
-      jresponse[1][RETURN_CODE_TAG] = 4;
-      jresponse[1][ERROR_MESSAGE_TAG] =
-          "error from tokenizer: " + std::string{msg};
-      free(msg);
-      goto Finish;
-    }
+  con.output.clear();
+  con.output_offset = 0;
+  return true;
+}
 
-    try {
-      jresponse[1][TOKENS_TAG] = json::parse(out);
-    } catch (std::exception &e) {
-      LOG_ERROR("error during parsing go tokenizer output: %s", e.what());
+static bool
+add_specs(arg_parser *                                            parser,
+          const char *                                            option,
+          const std::function<bool(const char *, std::string &)> &add) {
+  int count = arg_parser_count(parser, option);
+  if (count <= 0) {
+    return true;
+  }
 
-      jresponse[1][RETURN_CODE_TAG] = 5;
-      jresponse[1][ERROR_MESSAGE_TAG] =
-          "error during parsing go tokenizer output";
+  std::vector<const char *> specs(count);
+  if (arg_parser_get_args(parser, option, ArgString, specs.data(), count) !=
+      count) {
+    LOG_ERROR("can't parse %s values", option);
+    return false;
+  }
 
-      free(out);
-      if (msg) {
-        free(msg);
-      }
-      goto Finish;
+  for (const char *spec : specs) {
+    std::string err;
+    if (add(spec, err) == false) {
+      LOG_ERROR("invalid %s %s: %s", option, spec, err.c_str());
+      return false;
     }
+    LOG_DEBUG("%s: %s", option, spec);
+  }
 
-    free(out);
-    if (msg) {
-      LOG_WARNING("warning from go tokenizer: %s", msg)
-
-      free(msg);
-    }
-#endif
-  } else {
-    LOG_WARNING("not supported buffer type: %s", buf_type.c_str());
+  return true;
+}
 
-    jresponse[1][RETURN_CODE_TAG]   = 1;
-    jresponse[1][ERROR_MESSAGE_TAG] = "unsupported buffer type: " + buf_type;
-    goto Finish;
+static void set_verbose(bool verbose) {
+  // XXX sinks can't be removed, so verbose logging to stderr is kept until
+  // restart
+  static bool debug_sink = false;
+  if (verbose && debug_sink == false) {
+    LOGGER_ADD_STDERR_SINK(log_default_format, LogDebug | LogTrace);
+    LOG_INFO("verbose logging is on");
+    debug_sink = true;
+  } else if (verbose == false && debug_sink) {
+    LOG_WARNING("verbose logging can't be switched off without restart");
   }
 
+  hl::async_log::set_levels(LogFailure | LogError | LogWarning | LogInfo |
+                            (debug_sink ? LogDebug | LogTrace : 0));
+}
 
-  jresponse[1][RETURN_CODE_TAG]   = 0;
-  jresponse[1][ERROR_MESSAGE_TAG] = "";
+static std::shared_ptr<const hl::process_settings>
+make_settings(const hl::server_config &config) {
+  return std::make_shared<hl::process_settings>(hl::process_settings{
+      config.default_flags,
+      size_t(std::max(config.compress_threshold, 0)) * 1024});
+}
 
+static bool reload_config(const char *             path,
+                          const hl::server_config &cli_config,
+                          hl::process_context &    context,
+                          hl::scheduler *          scheduler,
+                          hl::executor *           executor,
+                          std::string &            err) {
+  if (path == NULL) {
+    err = "config is not set";
+    LOG_WARNING("can't reload config: %s", err.c_str());
+    return false;
+  }
 
-Finish:
-  if (fd > 0) {
-    close(fd);
-    remove(filename);
+  // keys, removed from the file, get values from command line
+  hl::server_config config = cli_config;
+  if (hl::read_config(path, config, err) == false) {
+    LOG_ERROR("can't reload config %s, keep previous: %s", path, err.c_str());
+    return false;
   }
 
-#ifndef DNDEBUG
-  try {
-    static json    response_schema = json::parse(response_schema_v11);
-    json_validator response_validator;
-    response_validator.set_root_schema(response_schema);
-    response_validator.validate(jresponse);
-  } catch (std::exception &e) {
-    LOG_ERROR("fail validating json response: %s", e.what());
+  set_verbose(config.verbose);
+  std::atomic_store(&context.settings, make_settings(config));
+  if (scheduler != nullptr) {
+    scheduler->set_limits(
+        std::max(config.max_inflight, 1),
+        std::max(config.max_queued, 0),
+        size_t(std::max(config.max_queue_cost, 0)) * 1024 * 1024);
+  }
+  if (executor != nullptr) {
+    executor->reload();
   }
-#endif
 
-  return jresponse.dump();
+  LOG_INFO("config %s reloaded", path);
+  return true;
 }
@@ -0,0 +1,206 @@
+#include "parse_profile.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <clang-c/Index.h>
+#include <fnmatch.h>
+
+#define DEFAULT_PROFILE   "full"
+#define DOWNGRADE_OPTION  "downgrade="
+#define SPEC_DELIMITER    ':'
+#define OPTION_DELIMITER  ','
+#define SLOW_BUFFERS_MAX  4096
+
+struct option_name {
+  const char * name;
+  unsigned int option;
+};
+
+static const option_name option_names[] = {
+    {"detailed-preprocessing-record",
+     CXTranslationUnit_DetailedPreprocessingRecord},
+    {"incomplete", CXTranslationUnit_Incomplete},
+    {"skip-function-bodies", CXTranslationUnit_SkipFunctionBodies},
+    {"keep-going", CXTranslationUnit_KeepGoing},
+    {"limit-skip-function-bodies-to-preamble",
+     CXTranslationUnit_LimitSkipFunctionBodiesToPreamble},
+};
+
+namespace hl {
+parse_profiles::parse_profiles(size_t max_size, unsigned int max_parse_ms)
+    : max_size_{max_size}
+    , max_parse_ms_{max_parse_ms} {
+  // full annotation, macros are annotated by detailed preprocessing record
+  profiles_.emplace_back(parse_profile{
+      DEFAULT_PROFILE,
+      CXTranslationUnit_DetailedPreprocessingRecord,
+      "fast"});
+
+  // without macros annotation, errors in headers don't stop parsing
+  profiles_.emplace_back(parse_profile{
+      "fast",
+      CXTranslationUnit_Incomplete | CXTranslationUnit_KeepGoing,
+      "minimal"});
+
+  // also without function bodies, so identifiers inside them are not
+  // annotated
+  profiles_.emplace_back(parse_profile{"minimal",
+                                       CXTranslationUnit_Incomplete |
+                                           CXTranslationUnit_KeepGoing |
+                                           CXTranslationUnit_SkipFunctionBodies,
+                                       ""});
+}
+
+bool parse_profiles::add_profile(const std::string &spec, std::string &err) {
+  size_t delimiter = spec.find(SPEC_DELIMITER);
+  if (delimiter == std::string::npos || delimiter == 0) {
+    err = "expected NAME:OPTION,OPTION,...";
+    return false;
+  }
+
+  parse_profile profile{spec.substr(0, delimiter), 0, ""};
+
+  size_t start = delimiter + 1;
+  while (start < spec.size()) {
+    size_t end = spec.find(OPTION_DELIMITER, start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+
+    std::string option = spec.substr(start, end - start);
+    start              = end + 1;
+
+    if (option.empty()) {
+      continue;
+    } else if (option.compare(0, sizeof(DOWNGRADE_OPTION) - 1,
+                              DOWNGRADE_OPTION) == 0) {
+      profile.downgrade = option.substr(sizeof(DOWNGRADE_OPTION) - 1);
+      continue;
+    }
+
+    bool known = false;
+    for (const option_name &name : option_names) {
+      if (option == name.name) {
+        profile.options |= name.option;
+        known = true;
+        break;
+      }
+    }
+    if (known == false) {
+      err = "unknown option: " + option;
+      return false;
+    }
+  }
+
+  if (profile.downgrade == profile.name) {
+    err = "profile can't be downgraded to itself";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (parse_profile &other : profiles_) {
+    if (other.name == profile.name) {
+      other = std::move(profile);
+      return true;
+    }
+  }
+  profiles_.emplace_back(std::move(profile));
+  return true;
+}
+
+bool parse_profiles::add_glob(const std::string &spec, std::string &err) {
+  size_t delimiter = spec.rfind(SPEC_DELIMITER);
+  if (delimiter == std::string::npos || delimiter == 0) {
+    err = "expected GLOB:NAME";
+    return false;
+  }
+
+  std::string name = spec.substr(delimiter + 1);
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (this->find(name) == nullptr) {
+    err = "unknown profile: " + name;
+    return false;
+  }
+
+  globs_.emplace_back(spec.substr(0, delimiter), std::move(name));
+  return true;
+}
+
+parse_profile parse_profiles::select(const std::string &requested,
+                                     const std::string &buf_name,
+                                     size_t             size) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  const parse_profile *profile = nullptr;
+  if (requested.empty() == false) {
+    profile = this->find(requested);
+    if (profile == nullptr) {
+      ALOG_WARNING("unknown parse profile: %s", requested.c_str());
+    } else {
+      // XXX explicitly requested profile is not downgraded
+      return *profile;
+    }
+  }
+
+  for (auto glob = globs_.begin(); profile == nullptr && glob != globs_.end();
+       ++glob) {
+    if (fnmatch(glob->first.c_str(), buf_name.c_str(), 0) == 0) {
+      profile = this->find(glob->second);
+    }
+  }
+
+  if (profile == nullptr) {
+    profile = this->find(DEFAULT_PROFILE);
+  }
+
+  auto slow = slow_.find(buf_name);
+  if (slow != slow_.end() && this->find(slow->second) != nullptr) {
+    profile = this->find(slow->second);
+  }
+
+  if (max_size_ != 0 && size > max_size_ &&
+      this->find(profile->downgrade) != nullptr) {
+    ALOG_DEBUG("buffer %s is too big for parse profile %s, use %s",
+               buf_name.c_str(),
+               profile->name.c_str(),
+               profile->downgrade.c_str());
+    profile = this->find(profile->downgrade);
+  }
+
+  return *profile;
+}
+
+void parse_profiles::report(const parse_profile &profile,
+                            const std::string &  buf_name,
+                            unsigned int         parse_ms) {
+  ALOG_DEBUG("parsing %s with profile %s took %ums",
+             buf_name.c_str(),
+             profile.name.c_str(),
+             parse_ms);
+
+  if (max_parse_ms_ == 0 || parse_ms <= max_parse_ms_ ||
+      profile.downgrade.empty()) {
+    return;
+  }
+
+  ALOG_INFO("parsing %s is too slow, downgrade profile to %s",
+            buf_name.c_str(),
+            profile.downgrade.c_str());
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (slow_.size() >= SLOW_BUFFERS_MAX) {
+    slow_.clear();
+  }
+  slow_[buf_name] = profile.downgrade;
+}
+
+const parse_profile *
+parse_profiles::find(const std::string &name) const noexcept {
+  for (const parse_profile &profile : profiles_) {
+    if (profile.name == name) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
+} // namespace hl
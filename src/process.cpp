@@ -0,0 +1,731 @@
+#include "process.hpp"
+#include "arena.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include "clang_tokenize.hpp"
+#include "compression.hpp"
+#include "hash.hpp"
+#include "header_stamp.hpp"
+#include "lexical_tokenize.hpp"
+#include "response_writer.hpp"
+#include "return_code.hpp"
+#include "rr_schemes.h"
+#include "token.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <clang-c/Index.h>
+#include <cstring>
+#include <cinttypes>
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <nlohmann/json-schema.hpp>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+#include <vector>
+
+#ifdef GO_TOKENIZER
+#  include "gotokenizer.h"
+#endif
+
+#define DELIMITER '\n'
+
+#define PROTOCOL_VERSION "v1.1"
+
+#define ARENA_BLOCK_SIZE 256 * 1024 // 256Kb, grows for big buffers
+
+#define MAX_KEPT_TOKENS_BUFFER 16 * 1024 * 1024 // 16Mb, bigger one is freed
+
+
+static hl::arena_list<hl::arena_string> split(const std::string &str) {
+  hl::arena_list<hl::arena_string> retval;
+
+  const char *start = str.c_str();
+  do {
+    const char *found = strchr(start, DELIMITER);
+    if (found) {
+      retval.emplace_back(start, found++);
+    } else {
+      retval.emplace_back(start);
+    }
+
+    start = found;
+  } while (start);
+
+  return retval;
+}
+
+static hl::arena_vector<const char *>
+to_argv(const hl::arena_list<hl::arena_string> &string_list) {
+  hl::arena_vector<const char *> retval;
+  retval.reserve(string_list.size());
+
+  for (const hl::arena_string &str : string_list) {
+    retval.emplace_back(str.c_str());
+  }
+
+  return retval;
+}
+
+#define VERSION_TAG         "version"
+#define ID_TAG              "id"
+#define BUF_TYPE_TAG        "buf_type"
+#define BUF_NAME_TAG        "buf_name"
+#define BUF_BODY_TAG        "buf_body"
+#define BUF_PATH_TAG        "buf_path"
+#define ADDITIONAL_INFO_TAG "additional_info"
+#define RETURN_CODE_TAG     "return_code"
+#define ERROR_MESSAGE_TAG   "error_message"
+#define TOKENS_TAG          "tokens"
+#define BUF_VERSION_TAG     "buf_version"
+#define BASE_VERSION_TAG    "base_version"
+#define EDITS_TAG           "edits"
+#define RANGE_TAG           "range"
+#define TEXT_TAG            "text"
+#define PROGRESSIVE_TAG     "progressive"
+#define PROFILE_TAG         "profile"
+#define COMPRESSION_TAG     "compression"
+#define PRIORITY_TAG        "priority"
+#define DEADLINE_TAG        "deadline_ms"
+#define REFRESH_TAG         "refresh"
+#define REFRESHED_TAG       "refreshed"
+#define ENCODING_TAG        "encoding"
+
+#define PRIORITY_BACKGROUND "background"
+#define ENCODING_DELTA      "delta"
+
+static uint64_t
+cache_key(const std::string &                   buf_type,
+          const std::string &                   buf_body,
+          const hl::arena_vector<const char *> &argv,
+          unsigned int                          options,
+          bool                                  delta_encoding,
+          const char *                          server_version);
+static void        serialize_tokens(const hl::token_list &tokens,
+                                    bool                  delta_encoding,
+                                    std::string &         out);
+static std::string compress_if_big(std::string response,
+                                   bool        compression,
+                                   size_t      threshold);
+static bool        resolve_path(const std::string &path,
+                                const std::string &allowed_dir,
+                                std::string &      out);
+static bool        read_file(const std::string &path, std::string &out);
+
+namespace hl {
+std::string process(const char *                            data,
+                    process_context &                       context,
+                    const std::function<void(std::string)> &partial,
+                    executor::dependencies &                deps) {
+  using nlohmann::json;
+  using nlohmann::json_schema::json_validator;
+
+  // XXX all containers with arena allocator must be created after the scope
+  static thread_local hl::arena request_arena{ARENA_BLOCK_SIZE};
+  hl::arena_scope               scope{request_arena};
+
+  hl::trace::request_scope     trace_scope;
+  hl::trace::clock::time_point decode_start = hl::trace::clock::now();
+  hl::trace::clock::time_point serialize_start;
+
+  int         message_number = -1;
+  std::string version;
+  std::string id;
+  std::string buf_type;
+  std::string buf_name;
+  std::string buf_body;
+  std::string additional_info;
+  std::string profile_name;
+  std::string buf_path;
+  std::string real_path;
+  long long   buf_version  = -1;
+  long long   base_version = -1;
+  bool        has_edits    = false;
+  bool        progressive  = false;
+  bool        compression  = false;
+  bool        refresh      = false;
+  bool        delta        = false;
+
+  std::vector<text_edit> edits;
+  std::string            sync_err;
+
+  // XXX tokens are serialized to buffer of the thread, so big responses
+  // don't grow new string every time
+  static thread_local std::string tokens_buffer;
+  std::string &                   serialized_tokens = tokens_buffer;
+
+  uint64_t      key = 0;
+  header_stamps stamps;
+  std::string   lexical_tokens;
+  std::string   error_message;
+  std::string   response;
+
+  json jrequest;
+  json jresponse;
+
+  char        filename[] = ".hl-server-tmp-file-XXXXXX";
+  int         fd         = -1;
+  int         written    = 0;
+  std::string err;
+
+  hl::arena_list<hl::arena_string> args;
+  hl::arena_vector<const char *>   argv;
+  hl::token_list                   tokens;
+  hl::parse_profile                profile{
+      "", CXTranslationUnit_DetailedPreprocessingRecord, ""};
+
+  std::chrono::steady_clock::time_point parse_start;
+  std::chrono::system_clock::time_point parse_time; // for stamps of headers
+
+  // settings can be replaced by reloading of config during the request
+  std::shared_ptr<const process_settings> settings =
+      std::atomic_load(&context.settings);
+
+  serialized_tokens.clear();
+  if (serialized_tokens.capacity() > MAX_KEPT_TOKENS_BUFFER) {
+    serialized_tokens.shrink_to_fit();
+  }
+
+
+  try {
+    static json schema = json::parse(request_schema_v11);
+
+
+    json_validator validator;
+    validator.set_root_schema(schema);
+
+    jrequest = json::parse(data);
+    validator.validate(jrequest);
+
+    json &jbody     = jrequest[1];
+    message_number  = jrequest[0];
+    version         = jbody[VERSION_TAG];
+    id              = jbody[ID_TAG];
+    buf_type        = jbody[BUF_TYPE_TAG];
+    buf_name        = jbody[BUF_NAME_TAG];
+    additional_info = jbody[ADDITIONAL_INFO_TAG];
+
+    json::iterator found = jbody.find(BUF_BODY_TAG);
+    if (found != jbody.end()) {
+      buf_body = std::move(found->get_ref<std::string &>());
+    }
+
+    found = jbody.find(BUF_PATH_TAG);
+    if (found != jbody.end()) {
+      buf_path = *found;
+    }
+
+    found = jbody.find(BUF_VERSION_TAG);
+    if (found != jbody.end()) {
+      buf_version = *found;
+    }
+
+    found = jbody.find(PROGRESSIVE_TAG);
+    if (found != jbody.end()) {
+      progressive = *found;
+    }
+
+    found = jbody.find(COMPRESSION_TAG);
+    if (found != jbody.end()) {
+      compression = true; // the only supported compression
+    }
+
+    found = jbody.find(ENCODING_TAG);
+    if (found != jbody.end()) {
+      delta = true; // the only supported encoding
+    }
+
+    found = jbody.find(REFRESH_TAG);
+    if (found != jbody.end()) {
+      refresh = *found;
+    }
+
+    found = jbody.find(PROFILE_TAG);
+    if (found != jbody.end()) {
+      profile_name = *found;
+    }
+
+    found = jbody.find(EDITS_TAG);
+    if (found != jbody.end()) {
+      has_edits    = true;
+      base_version = jbody[BASE_VERSION_TAG];
+
+      edits.reserve(found->size());
+      for (const json &jedit : *found) {
+        const json &range = jedit[RANGE_TAG];
+        edits.emplace_back(text_edit{
+            {range[0], range[1], range[2], range[3]},
+            jedit[TEXT_TAG]});
+      }
+    }
+  } catch (std::exception &e) {
+    LOG_ERROR("json handling error: %s", e.what());
+    return "";
+  }
+
+  trace_scope.begin(
+      hl::trace::tags{0, id, buf_name, message_number, buf_body.size(), 0});
+  hl::trace::phase("decode", decode_start);
+
+  jresponse[0]               = message_number;
+  jresponse[1][VERSION_TAG]  = version;
+  jresponse[1][ID_TAG]       = id;
+  jresponse[1][BUF_TYPE_TAG] = buf_type;
+  jresponse[1][BUF_NAME_TAG] = buf_name;
+  jresponse[1][TOKENS_TAG]   = json::object(); // placeholder
+  if (refresh) {
+    jresponse[1][REFRESHED_TAG] = true;
+  }
+
+
+  // buffer is read by the server, for example for batch requests, but only
+  // from allowed directory. The response is the same for not allowed and not
+  // existing files
+  if (buf_path.empty() == false &&
+      (resolve_path(buf_path, context.allowed_dir, real_path) == false ||
+       read_file(real_path, buf_body) == false)) {
+    ALOG_WARNING("can't read buffer %s from %s (allowed: %s)",
+                 buf_name.c_str(),
+                 buf_path.c_str(),
+                 context.allowed_dir.c_str());
+
+    jresponse[1][RETURN_CODE_TAG]   = CantReadBuffer;
+    jresponse[1][ERROR_MESSAGE_TAG] = "can't read buffer from " + buf_path;
+    goto Finish;
+  }
+
+  // restore complete buffer from kept version
+  if (refresh) {
+    if (context.documents == nullptr ||
+        context.documents->get(id, buf_name, buf_body) == false) {
+      ALOG_DEBUG("buffer %s for refresh is not kept", buf_name.c_str());
+      return "";
+    }
+  } else if (has_edits) {
+    if (context.documents == nullptr ||
+        context.documents->apply(id,
+                                 buf_name,
+                                 base_version,
+                                 buf_version,
+                                 edits,
+                                 buf_body,
+                                 sync_err) == false) {
+      ALOG_WARNING("can't apply edits for %s: %s",
+                   buf_name.c_str(),
+                   sync_err.c_str());
+
+      jresponse[1][RETURN_CODE_TAG]   = ResendFullBuffer;
+      jresponse[1][ERROR_MESSAGE_TAG] = "resend full buffer: " + sync_err;
+      goto Finish;
+    }
+  } else if (buf_version >= 0 && context.documents != nullptr) {
+    context.documents->update(id, buf_name, buf_version, buf_body);
+  }
+
+
+  trace_scope.set_size(buf_body.size());
+
+  if (buf_type == "cpp" || buf_type == "c") {
+    args = split(additional_info);
+    argv = to_argv(args);
+    for (const std::string &flag : settings->default_flags) {
+      argv.push_back(flag.c_str());
+    }
+
+    if (context.profiles != nullptr) {
+      profile =
+          context.profiles->select(profile_name, buf_name, buf_body.size());
+    }
+
+    // the same buffer with the same flags gives the same tokens
+    if (context.cache != nullptr || context.store != nullptr) {
+      key = cache_key(buf_type,
+                      buf_body,
+                      argv,
+                      profile.options,
+                      delta,
+                      context.server_version);
+    }
+
+    // XXX tokens are outdated after changing of headers, so refresh requests
+    // skip them. Other requests check stamps of headers, because not every
+    // buffer with the same tokens is watched
+    if (context.cache != nullptr && refresh == false) {
+      if (context.cache->get(key, serialized_tokens, stamps)) {
+        if (hl::stamps_valid(stamps)) {
+          ALOG_DEBUG("cache hit for %s, hits: %" PRIu64 ", misses: %" PRIu64,
+                     buf_name.c_str(),
+                     context.cache->hits(),
+                     context.cache->misses());
+          goto Dependencies;
+        }
+
+        ALOG_DEBUG("cached tokens are outdated for %s", buf_name.c_str());
+        context.cache->erase(key);
+        serialized_tokens.clear();
+      }
+
+      ALOG_DEBUG("cache miss for %s, hits: %" PRIu64 ", misses: %" PRIu64,
+                 buf_name.c_str(),
+                 context.cache->hits(),
+                 context.cache->misses());
+    }
+
+    // tokens from previous runs of the server, headers can be changed while
+    // the server was stopped
+    if (context.store != nullptr && refresh == false &&
+        context.store->get(key, serialized_tokens, stamps)) {
+      if (hl::stamps_valid(stamps)) {
+        ALOG_DEBUG("tokens store hit for %s", buf_name.c_str());
+
+        if (context.cache != nullptr) {
+          context.cache->put(key, serialized_tokens, stamps);
+        }
+        goto Dependencies;
+      }
+
+      ALOG_DEBUG("tokens in store are outdated for %s", buf_name.c_str());
+      serialized_tokens.clear();
+    }
+
+    // approximate tokens can be shown while libclang works
+    if (progressive && partial) {
+      serialize_tokens(hl::lexical_tokenize(buf_body.data(), buf_body.size()),
+                       delta,
+                       lexical_tokens);
+      hl::write_response(message_number,
+                         version,
+                         id,
+                         buf_type,
+                         buf_name,
+                         Success,
+                         error_message,
+                         refresh,
+                         true,
+                         lexical_tokens,
+                         response);
+      partial(compress_if_big(std::move(response),
+                              compression,
+                              settings->compress_threshold));
+      response.clear();
+    }
+
+    // create tmp file
+    fd = mkstemp(filename);
+    if (fd < 0) {
+      LOG_ERROR("can't open temporary file: %s", strerror(errno));
+
+      jresponse[1][RETURN_CODE_TAG]   = CantOpenTemporaryFile;
+      jresponse[1][ERROR_MESSAGE_TAG] = "can't open temporary file for buffer";
+      goto Finish;
+    }
+
+    written = write(fd, buf_body.c_str(), buf_body.size());
+    if (written < 0) {
+      LOG_ERROR("can't write buffer to temporary file: %s", strerror(errno));
+
+      jresponse[1][RETURN_CODE_TAG]   = CantWriteTemporaryFile;
+      jresponse[1][ERROR_MESSAGE_TAG] = "can't write buffer to temporary file";
+      goto Finish;
+    }
+
+
+    // tokenization, headers are needed for watching and for kept tokens
+    parse_start = std::chrono::steady_clock::now();
+    parse_time  = std::chrono::system_clock::now();
+    tokens      = hl::clang_tokenize(filename,
+                                     argv.size(),
+                                     argv.data(),
+                                     profile.options,
+                                     context.watch_headers ||
+                                             context.cache != nullptr ||
+                                             context.store != nullptr
+                                         ? &deps.files
+                                         : nullptr,
+                                     err);
+    if (context.profiles != nullptr) {
+      context.profiles->report(
+          profile,
+          buf_name,
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - parse_start)
+              .count());
+    }
+    if (err.empty() == false) {
+      LOG_ERROR("error from c/cpp tokenizer: %s", err.c_str());
+
+      // XXX clients, which requested lexical tokens, can keep them, but the
+      // return code is the same as without progressive highlighting
+      if (progressive && lexical_tokens.empty()) {
+        serialize_tokens(
+            hl::lexical_tokenize(buf_body.data(), buf_body.size()),
+            delta,
+            lexical_tokens);
+      }
+      serialized_tokens = std::move(lexical_tokens);
+      error_message     = "error from tokenizer: " + err;
+
+      jresponse[1][RETURN_CODE_TAG]   = TokenizerError;
+      jresponse[1][ERROR_MESSAGE_TAG] = error_message;
+      goto Finish;
+    }
+
+    trace_scope.set_tokens(tokens.size());
+    serialize_start = hl::trace::clock::now();
+
+    serialize_tokens(tokens, delta, serialized_tokens);
+
+    // XXX headers, which are changed during parsing, can't be checked later
+    if ((context.cache != nullptr || context.store != nullptr) &&
+        hl::make_stamps(deps.files, parse_time, stamps)) {
+      if (context.cache != nullptr) {
+        context.cache->put(key, serialized_tokens, stamps);
+      }
+      if (context.store != nullptr) {
+        context.store->put(key, serialized_tokens, stamps);
+      }
+    }
+
+  Dependencies:
+    // buffers with kept tokens are watched too, by headers from their stamps
+    if (context.watch_headers && deps.files.empty()) {
+      for (const header_stamp &stamp : stamps) {
+        deps.files.emplace_back(stamp.path);
+      }
+    }
+
+    // the same request without buffer tokenizes kept buffer again
+    if (context.watch_headers && deps.files.empty() == false &&
+        context.documents != nullptr) {
+      if (refresh == false && has_edits == false && buf_version < 0) {
+        context.documents->update(id, buf_name, buf_version, buf_body);
+      }
+
+      json &jbody = jrequest[1];
+      jbody.erase(BUF_BODY_TAG);
+      jbody.erase(BUF_VERSION_TAG);
+      jbody.erase(BASE_VERSION_TAG);
+      jbody.erase(EDITS_TAG);
+      jbody.erase(PROGRESSIVE_TAG);
+      jbody.erase(DEADLINE_TAG);
+      jbody[PRIORITY_TAG]  = PRIORITY_BACKGROUND;
+      jbody[REFRESH_TAG]   = true;
+      deps.refresh_request = jrequest.dump();
+    } else {
+      deps.files.clear();
+    }
+#ifdef GO_TOKENIZER
+  } else if (buf_type == "go") {
+    char *out  = NULL;
+    char *msg  = NULL;
+    int   code = 0;
+
+    code = go_tokenize((char *)buf_name.c_str(),
+                       (char *)buf_body.c_str(),
+                       &out,
+                       &msg);
+
+    if (code != 0) {
+      LOG_ERROR("error from go tokenizer: %s", msg)
+
+      jresponse[1][RETURN_CODE_TAG] = TokenizerError;
+      jresponse[1][ERROR_MESSAGE_TAG] =
+          "error from tokenizer: " + std::string{msg};
+      free(msg);
+      goto Finish;
+    }
+
+    try {
+      jresponse[1][TOKENS_TAG] = json::parse(out);
+
+      // go tokenizer gives tokens only as v1.1 object
+      if (delta) {
+        const json &jtokens = jresponse[1][TOKENS_TAG];
+        for (auto group = jtokens.begin(); group != jtokens.end(); ++group) {
+          for (const json &jpos : group.value()) {
+            tokens.emplace_back(hl::token{
+                hl::arena_string{group.key().c_str()},
+                {jpos[0].get<unsigned int>(),
+                 jpos[1].get<unsigned int>(),
+                 jpos[2].get<unsigned int>()}});
+          }
+        }
+
+        hl::write_delta_tokens(tokens, serialized_tokens);
+        jresponse[1][TOKENS_TAG] = json::object();
+      }
+    } catch (std::exception &e) {
+      LOG_ERROR("error during parsing go tokenizer output: %s", e.what());
+
+      jresponse[1][RETURN_CODE_TAG] = CantParseTokenizerData;
+      jresponse[1][ERROR_MESSAGE_TAG] =
+          "error during parsing go tokenizer output";
+
+      free(out);
+      if (msg) {
+        free(msg);
+      }
+      goto Finish;
+    }
+
+    free(out);
+    if (msg) {
+      ALOG_WARNING("warning from go tokenizer: %s", msg)
+
+      free(msg);
+    }
+#endif
+  } else {
+    ALOG_WARNING("not supported buffer type: %s", buf_type.c_str());
+
+    jresponse[1][RETURN_CODE_TAG]   = UnsupportedBufferType;
+    jresponse[1][ERROR_MESSAGE_TAG] = "unsupported buffer type: " + buf_type;
+    goto Finish;
+  }
+
+
+  jresponse[1][RETURN_CODE_TAG]   = Success;
+  jresponse[1][ERROR_MESSAGE_TAG] = "";
+
+
+Finish:
+  if (fd > 0) {
+    close(fd);
+    remove(filename);
+  }
+
+#ifndef DNDEBUG
+  try {
+    static json    response_schema = json::parse(response_schema_v11);
+    json_validator response_validator;
+    response_validator.set_root_schema(response_schema);
+    response_validator.validate(jresponse);
+  } catch (std::exception &e) {
+    LOG_ERROR("fail validating json response: %s", e.what());
+  }
+#endif
+
+  // tokens are serialized without json document
+  if (serialized_tokens.empty() == false) {
+    hl::write_response(message_number,
+                       version,
+                       id,
+                       buf_type,
+                       buf_name,
+                       jresponse[1][RETURN_CODE_TAG].get<int>(),
+                       error_message,
+                       refresh,
+                       false,
+                       serialized_tokens,
+                       response);
+    response = compress_if_big(std::move(response),
+                               compression,
+                               settings->compress_threshold);
+  } else {
+    response = compress_if_big(jresponse.dump(),
+                               compression,
+                               settings->compress_threshold);
+  }
+
+  if (serialize_start != hl::trace::clock::time_point{}) {
+    hl::trace::phase("serialize", serialize_start);
+  }
+  return response;
+}
+
+std::string make_error_response(const request_head &head,
+                                int                 return_code,
+                                const std::string & error_message) {
+  using nlohmann::json;
+
+  json jresponse;
+  jresponse[0]                    = head.message_number;
+  jresponse[1][VERSION_TAG]       = PROTOCOL_VERSION;
+  jresponse[1][ID_TAG]            = head.id;
+  jresponse[1][BUF_TYPE_TAG]      = head.buf_type;
+  jresponse[1][BUF_NAME_TAG]      = head.buf_name;
+  jresponse[1][RETURN_CODE_TAG]   = return_code;
+  jresponse[1][ERROR_MESSAGE_TAG] = error_message;
+  jresponse[1][TOKENS_TAG]        = json::object();
+
+  return jresponse.dump();
+}
+} // namespace hl
+
+
+static uint64_t
+cache_key(const std::string &                   buf_type,
+          const std::string &                   buf_body,
+          const hl::arena_vector<const char *> &argv,
+          unsigned int                          options,
+          bool                                  delta_encoding,
+          const char *                          server_version) {
+  hl::hasher hasher;
+
+  // XXX every part finished by null for avoid collisions of concatenations
+  hasher.update(buf_type.c_str(), buf_type.size() + 1);
+  hasher.update(buf_body.c_str(), buf_body.size() + 1);
+  for (const char *arg : argv) {
+    hasher.update(arg, strlen(arg) + 1);
+  }
+  hasher.update(&options, sizeof(options));
+  // XXX keys of v1.1 tokens are not changed, so kept tokens store is valid
+  if (delta_encoding) {
+    hasher.update(ENCODING_DELTA, sizeof(ENCODING_DELTA));
+  }
+  hasher.update(server_version, strlen(server_version) + 1);
+
+  return hasher.digest();
+}
+
+static void serialize_tokens(const hl::token_list &tokens,
+                             bool                  delta_encoding,
+                             std::string &         out) {
+  if (delta_encoding) {
+    hl::write_delta_tokens(tokens, out);
+  } else {
+    hl::write_tokens(tokens, out);
+  }
+}
+
+static std::string compress_if_big(std::string response,
+                                   bool        compression,
+                                   size_t      threshold) {
+  std::string frame;
+  if (compression && threshold != 0 && response.size() > threshold &&
+      hl::compress_frame(response, frame)) {
+    return frame;
+  }
+
+  return response;
+}
+
+static bool resolve_path(const std::string &path,
+                         const std::string &allowed_dir,
+                         std::string &      out) {
+  char resolved[PATH_MAX];
+  if (allowed_dir.empty() || realpath(path.c_str(), resolved) == nullptr) {
+    return false;
+  }
+  out = resolved;
+
+  // XXX `/dir2/file` is not inside of `/dir`
+  return out.size() > allowed_dir.size() &&
+         out.compare(0, allowed_dir.size(), allowed_dir) == 0 &&
+         (allowed_dir.back() == '/' || out[allowed_dir.size()] == '/');
+}
+
+static bool read_file(const std::string &path, std::string &out) {
+  std::ifstream file{path, std::ios::binary};
+  if (file.is_open() == false) {
+    return false;
+  }
+
+  out.assign(std::istreambuf_iterator<char>{file},
+             std::istreambuf_iterator<char>{});
+  return file.bad() == false;
+}
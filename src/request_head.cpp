@@ -0,0 +1,378 @@
+#include "request_head.hpp"
+#include <cstring>
+
+#define VERSION_TAG  "version"
+#define ID_TAG       "id"
+#define BUF_TYPE_TAG "buf_type"
+#define BUF_NAME_TAG "buf_name"
+#define PRIORITY_TAG "priority"
+#define DEADLINE_TAG "deadline_ms"
+#define EDITS_TAG    "edits"
+#define FLAGS_TAG    "additional_info"
+#define REFRESH_TAG  "refresh"
+#define CONTROL_TAG  "control"
+#define BATCH_TAG    "batch"
+
+#define PRIORITY_INTERACTIVE "interactive"
+#define PRIORITY_BACKGROUND  "background"
+
+#define FLAGS_DELIMITER '\n'
+
+#define MAX_DEPTH 64
+
+
+namespace {
+struct scanner {
+  const char *cur;
+  const char *end;
+};
+} // namespace
+
+static void skip_spaces(scanner &sc) noexcept;
+static bool consume(scanner &sc, char symbol) noexcept;
+static bool read_string(scanner &sc, std::string &out) noexcept;
+static bool skip_string(scanner &sc) noexcept;
+static bool read_integer(scanner &sc, long long &out) noexcept;
+static bool skip_value(scanner &sc, int depth) noexcept;
+static void append_utf8(std::string &out, unsigned long code_point) noexcept;
+static bool read_hex4(scanner &sc, unsigned long &out) noexcept;
+
+namespace hl {
+bool peek_request_head(const char *  data,
+                       size_t        size,
+                       request_head &head) noexcept {
+  scanner     sc{data, data + size};
+  long long   message_number = 0;
+  std::string key;
+  std::string priority;
+  std::string flags;
+
+  skip_spaces(sc);
+  if (consume(sc, '[') == false) {
+    return false;
+  }
+
+  skip_spaces(sc);
+  if (read_integer(sc, message_number) == false) {
+    return false;
+  }
+  head.message_number = static_cast<int>(message_number);
+
+  skip_spaces(sc);
+  if (consume(sc, ',') == false) {
+    return false;
+  }
+
+  skip_spaces(sc);
+  if (consume(sc, '{') == false) {
+    return false;
+  }
+
+  skip_spaces(sc);
+  if (consume(sc, '}')) {
+    return true;
+  }
+
+  for (;;) {
+    skip_spaces(sc);
+    if (read_string(sc, key) == false) {
+      return false;
+    }
+
+    skip_spaces(sc);
+    if (consume(sc, ':') == false) {
+      return false;
+    }
+
+    skip_spaces(sc);
+    bool ok = false;
+    if (key == VERSION_TAG) {
+      ok = read_string(sc, head.version);
+    } else if (key == ID_TAG) {
+      ok = read_string(sc, head.id);
+    } else if (key == BUF_TYPE_TAG) {
+      ok = read_string(sc, head.buf_type);
+    } else if (key == BUF_NAME_TAG) {
+      ok = read_string(sc, head.buf_name);
+    } else if (key == PRIORITY_TAG) {
+      ok = read_string(sc, priority);
+      if (priority == PRIORITY_INTERACTIVE) {
+        head.priority = hl::PriorityInteractive;
+      } else if (priority == PRIORITY_BACKGROUND) {
+        head.priority = hl::PriorityBackground;
+      } else {
+        head.priority = hl::PriorityNormal;
+      }
+    } else if (key == DEADLINE_TAG) {
+      ok = read_integer(sc, head.deadline_ms);
+    } else if (key == FLAGS_TAG) {
+      ok = read_string(sc, flags);
+      for (size_t i = 0; i < flags.size(); ++i) {
+        if (flags[i] != FLAGS_DELIMITER &&
+            (i == 0 || flags[i - 1] == FLAGS_DELIMITER)) {
+          ++head.flags_count;
+        }
+      }
+    } else if (key == EDITS_TAG) {
+      head.incremental = true;
+      ok               = skip_value(sc, 0);
+    } else if (key == REFRESH_TAG) {
+      head.refresh = sc.end - sc.cur >= 4 && memcmp(sc.cur, "true", 4) == 0;
+      ok           = skip_value(sc, 0);
+    } else if (key == CONTROL_TAG) {
+      ok = read_string(sc, head.control);
+    } else if (key == BATCH_TAG) {
+      head.batch = true;
+      ok         = skip_value(sc, 0);
+    } else {
+      ok = skip_value(sc, 0);
+    }
+    if (ok == false) {
+      return false;
+    }
+
+    skip_spaces(sc);
+    if (consume(sc, ',')) {
+      continue;
+    } else if (consume(sc, '}')) {
+      return true;
+    }
+
+    return false;
+  }
+}
+} // namespace hl
+
+
+static void skip_spaces(scanner &sc) noexcept {
+  while (sc.cur != sc.end &&
+         (*sc.cur == ' ' || *sc.cur == '\t' || *sc.cur == '\r' ||
+          *sc.cur == '\n')) {
+    ++sc.cur;
+  }
+}
+
+static bool consume(scanner &sc, char symbol) noexcept {
+  if (sc.cur != sc.end && *sc.cur == symbol) {
+    ++sc.cur;
+    return true;
+  }
+  return false;
+}
+
+static bool read_hex4(scanner &sc, unsigned long &out) noexcept {
+  if (sc.end - sc.cur < 4) {
+    return false;
+  }
+
+  out = 0;
+  for (int i = 0; i < 4; ++i, ++sc.cur) {
+    char c = *sc.cur;
+    out <<= 4;
+    if (c >= '0' && c <= '9') {
+      out |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      out |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      out |= c - 'A' + 10;
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void append_utf8(std::string &out, unsigned long code_point) noexcept {
+  if (code_point < 0x80) {
+    out.push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+static bool read_string(scanner &sc, std::string &out) noexcept {
+  if (consume(sc, '"') == false) {
+    return false;
+  }
+
+  out.clear();
+  while (sc.cur != sc.end) {
+    // copy all before next quote or escape at once
+    const char *start = sc.cur;
+    while (sc.cur != sc.end && *sc.cur != '"' && *sc.cur != '\\') {
+      ++sc.cur;
+    }
+    out.append(start, sc.cur);
+
+    if (sc.cur == sc.end) {
+      return false;
+    } else if (*sc.cur == '"') {
+      ++sc.cur;
+      return true;
+    }
+
+    // escape sequence
+    if (++sc.cur == sc.end) {
+      return false;
+    }
+    char escaped = *sc.cur++;
+    switch (escaped) {
+    case '"':
+    case '\\':
+    case '/':
+      out.push_back(escaped);
+      break;
+    case 'b':
+      out.push_back('\b');
+      break;
+    case 'f':
+      out.push_back('\f');
+      break;
+    case 'n':
+      out.push_back('\n');
+      break;
+    case 'r':
+      out.push_back('\r');
+      break;
+    case 't':
+      out.push_back('\t');
+      break;
+    case 'u': {
+      unsigned long code_point = 0;
+      if (read_hex4(sc, code_point) == false) {
+        return false;
+      }
+
+      // surrogate pair
+      if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        unsigned long low = 0;
+        if (consume(sc, '\\') == false || consume(sc, 'u') == false ||
+            read_hex4(sc, low) == false || low < 0xDC00 || low > 0xDFFF) {
+          return false;
+        }
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+      }
+
+      append_utf8(out, code_point);
+    } break;
+    default:
+      return false;
+    }
+  }
+
+  return false;
+}
+
+static bool skip_string(scanner &sc) noexcept {
+  if (consume(sc, '"') == false) {
+    return false;
+  }
+
+  for (;;) {
+    const char *found =
+        static_cast<const char *>(memchr(sc.cur, '"', sc.end - sc.cur));
+    if (found == nullptr) {
+      return false;
+    }
+
+    // quote is escaped if it has odd count of backslashes before
+    size_t      backslashes = 0;
+    const char *back        = found;
+    while (back != sc.cur && *(back - 1) == '\\') {
+      --back;
+      ++backslashes;
+    }
+
+    sc.cur = found + 1;
+    if (backslashes % 2 == 0) {
+      return true;
+    }
+  }
+}
+
+static bool read_integer(scanner &sc, long long &out) noexcept {
+  const char *start = sc.cur;
+  if (sc.cur != sc.end && *sc.cur == '-') {
+    ++sc.cur;
+  }
+
+  const char *digits = sc.cur;
+  out                = 0;
+  while (sc.cur != sc.end && *sc.cur >= '0' && *sc.cur <= '9') {
+    out = out * 10 + (*sc.cur - '0');
+    ++sc.cur;
+  }
+
+  if (digits == sc.cur) {
+    return false;
+  }
+  if (*start == '-') {
+    out = -out;
+  }
+
+  return true;
+}
+
+static bool skip_value(scanner &sc, int depth) noexcept {
+  if (sc.cur == sc.end || depth > MAX_DEPTH) {
+    return false;
+  }
+
+  switch (*sc.cur) {
+  case '"':
+    return skip_string(sc);
+  case '{':
+  case '[': {
+    char close = *sc.cur == '{' ? '}' : ']';
+    ++sc.cur;
+
+    skip_spaces(sc);
+    if (consume(sc, close)) {
+      return true;
+    }
+
+    for (;;) {
+      skip_spaces(sc);
+      if (close == '}') {
+        if (skip_string(sc) == false) {
+          return false;
+        }
+        skip_spaces(sc);
+        if (consume(sc, ':') == false) {
+          return false;
+        }
+        skip_spaces(sc);
+      }
+
+      if (skip_value(sc, depth + 1) == false) {
+        return false;
+      }
+
+      skip_spaces(sc);
+      if (consume(sc, ',')) {
+        continue;
+      }
+      return consume(sc, close);
+    }
+  }
+  default:
+    // numbers and literals
+    while (sc.cur != sc.end && *sc.cur != ',' && *sc.cur != '}' &&
+           *sc.cur != ']' && *sc.cur != ' ' && *sc.cur != '\t' &&
+           *sc.cur != '\r' && *sc.cur != '\n') {
+      ++sc.cur;
+    }
+    return true;
+  }
+}
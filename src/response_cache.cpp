@@ -0,0 +1,97 @@
+#include "response_cache.hpp"
+
+static size_t entry_size(const std::string &      tokens,
+                         const hl::header_stamps &stamps) noexcept;
+
+namespace hl {
+response_cache::response_cache(size_t max_bytes)
+    : max_bytes_{max_bytes}
+    , bytes_{0}
+    , hits_{0}
+    , misses_{0} {
+}
+
+bool response_cache::get(uint64_t       key,
+                         std::string &  tokens,
+                         header_stamps &stamps) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = entries_.find(key);
+  if (found == entries_.end()) {
+    ++misses_;
+    return false;
+  }
+
+  ++hits_;
+  usage_.splice(usage_.begin(), usage_, found->second.usage);
+  tokens = found->second.tokens;
+  stamps = found->second.stamps;
+  return true;
+}
+
+void response_cache::put(uint64_t             key,
+                         const std::string &  tokens,
+                         const header_stamps &stamps) {
+  size_t size = entry_size(tokens, stamps);
+  if (size > max_bytes_) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = entries_.find(key);
+  if (found != entries_.end()) {
+    bytes_ -= found->second.size;
+    found->second.tokens = tokens;
+    found->second.stamps = stamps;
+    found->second.size   = size;
+    usage_.splice(usage_.begin(), usage_, found->second.usage);
+  } else {
+    usage_.push_front(key);
+    entries_.emplace(key, entry{tokens, stamps, size, usage_.begin()});
+  }
+  bytes_ += size;
+
+  while (bytes_ > max_bytes_) {
+    auto last = entries_.find(usage_.back());
+    bytes_ -= last->second.size;
+    entries_.erase(last);
+    usage_.pop_back();
+  }
+}
+
+void response_cache::erase(uint64_t key) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = entries_.find(key);
+  if (found == entries_.end()) {
+    return;
+  }
+
+  --hits_;
+  ++misses_;
+  bytes_ -= found->second.size;
+  usage_.erase(found->second.usage);
+  entries_.erase(found);
+}
+
+uint64_t response_cache::hits() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return hits_;
+}
+
+uint64_t response_cache::misses() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return misses_;
+}
+} // namespace hl
+
+
+static size_t entry_size(const std::string &      tokens,
+                         const hl::header_stamps &stamps) noexcept {
+  size_t size = tokens.size();
+  for (const hl::header_stamp &stamp : stamps) {
+    size += sizeof(stamp) + stamp.path.size();
+  }
+  return size;
+}
@@ -0,0 +1,279 @@
+#include "response_writer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#define VERSION_TAG       "version"
+#define ID_TAG            "id"
+#define BUF_TYPE_TAG      "buf_type"
+#define BUF_NAME_TAG      "buf_name"
+#define RETURN_CODE_TAG   "return_code"
+#define ERROR_MESSAGE_TAG "error_message"
+#define REFRESHED_TAG     "refreshed"
+#define PARTIAL_TAG       "partial"
+#define TOKENS_TAG        "tokens"
+#define DATA_TAG          "data"
+#define GROUPS_TAG        "groups"
+
+// comma, brackets, two commas and three 10-digit numbers
+#define MAX_BYTES_PER_TOKEN 35
+
+// comma, three commas and four 10-digit numbers
+#define MAX_BYTES_PER_DELTA 44
+
+// groups are names of cursor and type kinds, so normally there are less
+#define MAX_CACHED_GROUPS 256
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static char *write_uint(char *out, unsigned int value) noexcept;
+static void append_string(std::string &out, const std::string &str);
+// escaped group name with `:[`, valid until the next call
+static const std::string &group_prefix(const hl::arena_string &group);
+
+namespace hl {
+void write_tokens(const token_list &tokens, std::string &out) {
+  // XXX json object has sorted keys, but tokens in group must have the same
+  // order as in list
+  using locations_type = arena_vector<const token_location *>;
+  std::map<arena_string,
+           locations_type,
+           std::less<arena_string>,
+           arena_allocator<std::pair<const arena_string, locations_type>>>
+      groups;
+
+  auto last = groups.end();
+  for (const token &tok : tokens) {
+    if (last == groups.end() || last->first != tok.group) {
+      last = groups.find(tok.group);
+      if (last == groups.end()) {
+        last = groups
+                   .emplace(tok.group, locations_type{})
+                   .first;
+      }
+    }
+    last->second.push_back(&tok.pos);
+  }
+
+  out += '{';
+  for (auto group = groups.begin(); group != groups.end(); ++group) {
+    if (group != groups.begin()) {
+      out += ',';
+    }
+
+    out += group_prefix(group->first);
+
+    // write coordinates directly to reserved memory
+    const locations_type &locations = group->second;
+    size_t                offset    = out.size();
+    out.resize(offset + locations.size() * MAX_BYTES_PER_TOKEN);
+
+    char *cur = &out[offset];
+    for (size_t i = 0; i < locations.size(); ++i) {
+      const token_location &pos = *locations[i];
+
+      if (i != 0) {
+        *cur++ = ',';
+      }
+      *cur++ = '[';
+      cur    = write_uint(cur, pos[0]);
+      *cur++ = ',';
+      cur    = write_uint(cur, pos[1]);
+      *cur++ = ',';
+      cur    = write_uint(cur, pos[2]);
+      *cur++ = ']';
+    }
+    out.resize(cur - out.data());
+
+    out += ']';
+  }
+  out += '}';
+}
+
+void write_delta_tokens(const token_list &tokens, std::string &out) {
+  using indexes_type =
+      std::map<arena_string,
+               unsigned int,
+               std::less<arena_string>,
+               arena_allocator<std::pair<const arena_string, unsigned int>>>;
+
+  // XXX tokenizers give tokens in order of position, but tokens converted
+  // from v1.1 object (from go tokenizer) are grouped
+  arena_vector<const token *> sorted;
+  sorted.reserve(tokens.size());
+  for (const token &tok : tokens) {
+    sorted.push_back(&tok);
+  }
+  std::stable_sort(sorted.begin(),
+                   sorted.end(),
+                   [](const token *lhs, const token *rhs) {
+                     return lhs->pos[0] < rhs->pos[0] ||
+                            (lhs->pos[0] == rhs->pos[0] &&
+                             lhs->pos[1] < rhs->pos[1]);
+                   });
+
+  // groups are numbered in order of first appearance
+  indexes_type                       indexes;
+  arena_vector<const arena_string *> groups;
+
+  out += "{\"" DATA_TAG "\":[";
+
+  // write numbers directly to reserved memory
+  size_t offset = out.size();
+  out.resize(offset + sorted.size() * MAX_BYTES_PER_DELTA);
+
+  char *       cur         = &out[offset];
+  unsigned int prev_row    = 0;
+  unsigned int prev_column = 0;
+  auto         last        = indexes.end();
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    const token &tok = *sorted[i];
+
+    if (last == indexes.end() || last->first != tok.group) {
+      last = indexes.find(tok.group);
+      if (last == indexes.end()) {
+        last = indexes.emplace(tok.group, groups.size()).first;
+        groups.push_back(&last->first);
+      }
+    }
+
+    unsigned int row    = tok.pos[0];
+    unsigned int column = tok.pos[1];
+
+    if (i != 0) {
+      *cur++ = ',';
+    }
+    cur    = write_uint(cur, row - prev_row);
+    *cur++ = ',';
+    cur    = write_uint(cur, row == prev_row ? column - prev_column : column);
+    *cur++ = ',';
+    cur    = write_uint(cur, tok.pos[2]);
+    *cur++ = ',';
+    cur    = write_uint(cur, last->second);
+
+    prev_row    = row;
+    prev_column = column;
+  }
+  out.resize(cur - out.data());
+
+  out += "],\"" GROUPS_TAG "\":[";
+  for (size_t i = 0; i < groups.size(); ++i) {
+    if (i != 0) {
+      out += ',';
+    }
+    // without `:[` of the prefix
+    const std::string &prefix = group_prefix(*groups[i]);
+    out.append(prefix, 0, prefix.size() - 2);
+  }
+  out += "]}";
+}
+
+void write_response(int                message_number,
+                    const std::string &version,
+                    const std::string &id,
+                    const std::string &buf_type,
+                    const std::string &buf_name,
+                    int                return_code,
+                    const std::string &error_message,
+                    bool               refreshed,
+                    bool               partial,
+                    const std::string &tokens,
+                    std::string &      out) {
+  out.reserve(out.size() + tokens.size() + buf_name.size() +
+              error_message.size() + 128);
+
+  out += '[';
+  out += std::to_string(message_number);
+  out += ",{\"" BUF_NAME_TAG "\":";
+  append_string(out, buf_name);
+  out += ",\"" BUF_TYPE_TAG "\":";
+  append_string(out, buf_type);
+  out += ",\"" ERROR_MESSAGE_TAG "\":";
+  append_string(out, error_message);
+  out += ",\"" ID_TAG "\":";
+  append_string(out, id);
+  if (partial) {
+    out += ",\"" PARTIAL_TAG "\":true";
+  }
+  if (refreshed) {
+    out += ",\"" REFRESHED_TAG "\":true";
+  }
+  out += ",\"" RETURN_CODE_TAG "\":";
+  out += std::to_string(return_code);
+  out += ",\"" TOKENS_TAG "\":";
+  out += tokens;
+  out += ",\"" VERSION_TAG "\":";
+  append_string(out, version);
+  out += "}]";
+}
+} // namespace hl
+
+
+static char *write_uint(char *out, unsigned int value) noexcept {
+  char  buf[10];
+  char *end = buf + sizeof(buf);
+  char *cur = end;
+
+  while (value >= 100) {
+    unsigned int index = (value % 100) * 2;
+    value /= 100;
+    *--cur = digit_pairs[index + 1];
+    *--cur = digit_pairs[index];
+  }
+
+  if (value >= 10) {
+    unsigned int index = value * 2;
+    *--cur             = digit_pairs[index + 1];
+    *--cur             = digit_pairs[index];
+  } else {
+    *--cur = static_cast<char>('0' + value);
+  }
+
+  while (cur != end) {
+    *out++ = *cur++;
+  }
+  return out;
+}
+
+static void append_string(std::string &out, const std::string &str) {
+  // escaping must be the same as in json dump, strings are short
+  out += nlohmann::json(str).dump();
+}
+
+static const std::string &group_prefix(const hl::arena_string &group) {
+  // XXX there are few groups, so linear search is cheaper then hashing
+  static thread_local std::vector<std::pair<std::string, std::string>>
+                                  prefixes;
+  static thread_local std::string not_cached;
+
+  for (const auto &prefix : prefixes) {
+    if (prefix.first.size() == group.size() &&
+        memcmp(prefix.first.data(), group.data(), group.size()) == 0) {
+      return prefix.second;
+    }
+  }
+
+  std::string name{group.data(), group.size()};
+  std::string prefix;
+  append_string(prefix, name);
+  prefix += ":[";
+
+  if (prefixes.size() >= MAX_CACHED_GROUPS) {
+    not_cached = std::move(prefix);
+    return not_cached;
+  }
+
+  prefixes.emplace_back(std::move(name), std::move(prefix));
+  return prefixes.back().second;
+}
@@ -0,0 +1,361 @@
+#include "scheduler.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <algorithm>
+#include <cinttypes>
+#include <iterator>
+
+#define AGING_MS 1000 // waiting time for raising priority by one level
+
+// XXX cost is measured in bytes of buffer: every request parses headers, and
+// every flag (like -I or -include) can add more of them
+#define BASE_COST        256 * 1024
+#define FLAG_COST        16 * 1024
+#define DEFAULT_MS_COST  1.0 / 1024 // until real handling time is known
+#define MS_COST_WEIGHT   0.2        // of last request in average
+#define MIN_RETRY_AFTER  100        // ms
+#define MAX_RETRY_AFTER  30000      // ms
+
+static int  effective_priority(const hl::job &                  queued,
+                               const hl::job::clock::time_point &now) noexcept;
+static bool is_expired(const hl::job &                  queued,
+                       const hl::job::clock::time_point &now) noexcept;
+static size_t estimate_cost(const hl::request_head &head,
+                            const std::string &     data) noexcept;
+
+namespace hl {
+scheduler::scheduler(size_t max_inflight,
+                     size_t max_client_queued,
+                     size_t max_queued_cost)
+    : max_inflight_{max_inflight}
+    , max_client_queued_{max_client_queued}
+    , max_queued_cost_{max_queued_cost}
+    , tag_counter_{0}
+    , last_served_{0}
+    , queued_{0}
+    , queued_cost_{0}
+    , rejected_{0}
+    , ms_per_cost_{DEFAULT_MS_COST} {
+}
+
+void scheduler::set_limits(size_t max_inflight,
+                           size_t max_client_queued,
+                           size_t max_queued_cost) noexcept {
+  max_inflight_      = max_inflight;
+  max_client_queued_ = max_client_queued;
+  max_queued_cost_   = max_queued_cost;
+}
+
+bool scheduler::push(uint64_t      client,
+                     request_head  head,
+                     std::string   data,
+                     unsigned int &retry_after_ms) {
+  client_state &state = clients_[client];
+  size_t        cost  = estimate_cost(head, data);
+
+  // queued request for the buffer gives actual tokens anyway
+  if (head.refresh) {
+    for (const job &queued : state.queue) {
+      if (queued.head.buf_name == head.buf_name) {
+        ALOG_DEBUG("ignore refresh of queued %s", head.buf_name.c_str());
+        return true;
+      }
+    }
+  }
+
+  // newer request with complete buffer makes previous ones useless, but
+  // every item of batch must get its response
+  if (head.buf_name.empty() == false && head.incremental == false &&
+      head.refresh == false && head.batch_item == false) {
+    auto same_buffer = [&head](const job &queued) {
+      return queued.head.buf_name == head.buf_name &&
+             queued.head.batch_item == false;
+    };
+
+    auto first =
+        std::find_if(state.queue.begin(), state.queue.end(), same_buffer);
+    if (first != state.queue.end()) {
+      // XXX erasing from the end doesn't invalidate first
+      auto new_end =
+          std::remove_if(std::next(first), state.queue.end(), same_buffer);
+      size_t removed = std::distance(new_end, state.queue.end()) + 1;
+      this->add_replaced(job{first->client,
+                             first->tag,
+                             std::move(first->head),
+                             "",
+                             first->received,
+                             first->cost});
+
+      for (auto iter = new_end; iter != state.queue.end(); ++iter) {
+        queued_cost_ -= iter->cost;
+        this->add_replaced(std::move(*iter));
+      }
+      state.queue.erase(new_end, state.queue.end());
+      queued_ -= removed - 1;
+      queued_cost_ -= first->cost;
+      queued_cost_ += cost;
+
+      ALOG_DEBUG("ignore %zu old requests for %s",
+                 removed,
+                 head.buf_name.c_str());
+
+      first->head     = std::move(head);
+      first->data     = std::move(data);
+      first->received = job::clock::now();
+      first->cost     = cost;
+      return true;
+    }
+  }
+
+  // fail fast instead of unlimited waiting
+  if ((max_client_queued_ != 0 && state.queue.size() >= max_client_queued_) ||
+      (max_queued_cost_ != 0 && queued_cost_ + cost > max_queued_cost_ &&
+       queued_ != 0)) {
+    // items of batch wait in batch tracker, it is not overload
+    if (head.batch_item) {
+      return false;
+    }
+
+    ++rejected_;
+    retry_after_ms = this->retry_after();
+
+    ALOG_WARNING("server is busy, reject %s: client queued %zu, queued %zu "
+                 "with cost %zu, inflight %zu, rejected %" PRIu64,
+                 head.buf_name.c_str(),
+                 state.queue.size(),
+                 queued_,
+                 queued_cost_,
+                 started_.size(),
+                 rejected_);
+    return false;
+  }
+
+  state.queue.emplace_back(job{client,
+                                ++tag_counter_,
+                                std::move(head),
+                                std::move(data),
+                                job::clock::now(),
+                                cost});
+  ++queued_;
+  queued_cost_ += cost;
+
+  ALOG_DEBUG("queued %zu requests with cost %zu", queued_, queued_cost_);
+  return true;
+}
+
+bool scheduler::pop(const std::function<bool(const job &)> &can_start,
+                    job &                                   out) {
+  if (queued_ == 0) {
+    return false;
+  }
+
+  job::clock::time_point now = job::clock::now();
+
+  // the best request by priority; with equal priority the first client
+  // after the last served one wins
+  std::map<uint64_t, client_state>::iterator best_client = clients_.end();
+  std::deque<job>::iterator                  best;
+  int                                        best_priority = 0;
+
+  auto start = clients_.upper_bound(last_served_);
+  if (start == clients_.end()) {
+    start = clients_.begin();
+  }
+
+  auto iter = start;
+  do {
+    client_state &        state = iter->second;
+    std::set<std::string> seen_buffers;
+    for (auto found = state.queue.begin(); found != state.queue.end();
+         ++found) {
+      // only the first request for buffer can be started
+      const std::string &buf_name = found->head.buf_name;
+      if (buf_name.empty() == false &&
+          (state.started_buffers.count(buf_name) != 0 ||
+           seen_buffers.insert(buf_name).second == false)) {
+        continue;
+      }
+
+      // items of batch are limited only by the executor, so a batch can use
+      // all free threads or workers
+      if (state.inflight >= max_inflight_ &&
+          found->head.batch_item == false) {
+        continue;
+      }
+
+      int priority = effective_priority(*found, now);
+      if (best_client != clients_.end() && priority >= best_priority) {
+        continue;
+      }
+      if (can_start(*found) == false) {
+        continue;
+      }
+
+      best_client   = iter;
+      best          = found;
+      best_priority = priority;
+    }
+
+    if (++iter == clients_.end()) {
+      iter = clients_.begin();
+    }
+  } while (iter != start);
+
+  if (best_client == clients_.end()) {
+    return false;
+  }
+
+  out = std::move(*best);
+  best_client->second.queue.erase(best);
+  if (out.head.batch_item == false) {
+    ++best_client->second.inflight;
+  }
+  --queued_;
+  queued_cost_ -= out.cost;
+
+  if (out.head.buf_name.empty() == false) {
+    best_client->second.started_buffers.insert(out.head.buf_name);
+  }
+  started_[out.tag] = started_job{
+      out.client, out.head.buf_name, out.cost, out.head.batch_item, now};
+  last_served_ = out.client;
+  return true;
+}
+
+bool scheduler::pop_expired(job &out) {
+  if (queued_ == 0) {
+    return false;
+  }
+
+  job::clock::time_point now = job::clock::now();
+  for (auto &client : clients_) {
+    std::deque<job> &queue = client.second.queue;
+    for (auto found = queue.begin(); found != queue.end(); ++found) {
+      if (is_expired(*found, now)) {
+        out = std::move(*found);
+        queue.erase(found);
+        --queued_;
+        queued_cost_ -= out.cost;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool scheduler::finish(uint64_t tag, uint64_t &client) {
+  auto found = started_.find(tag);
+  if (found == started_.end()) {
+    return false;
+  }
+
+  const started_job &started = found->second;
+  client                     = started.client;
+
+  auto state = clients_.find(client);
+  if (state != clients_.end()) {
+    if (started.batch_item == false) {
+      --state->second.inflight;
+    }
+    state->second.started_buffers.erase(started.buf_name);
+  }
+
+  // average of handling time is used for estimating of retry time
+  double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       job::clock::now() - started.started)
+                       .count();
+  ms_per_cost_ = ms_per_cost_ * (1 - MS_COST_WEIGHT) +
+                 elapsed / started.cost * MS_COST_WEIGHT;
+
+  started_.erase(found);
+
+  return true;
+}
+
+bool scheduler::client_of(uint64_t tag, uint64_t &client) const {
+  auto found = started_.find(tag);
+  if (found == started_.end()) {
+    return false;
+  }
+
+  client = found->second.client;
+  return true;
+}
+
+std::list<job> scheduler::take_replaced() {
+  std::list<job> retval;
+  retval.swap(replaced_);
+  return retval;
+}
+
+void scheduler::remove_client(uint64_t client) {
+  auto found = clients_.find(client);
+  if (found == clients_.end()) {
+    return;
+  }
+
+  queued_ -= found->second.queue.size();
+  for (const job &queued : found->second.queue) {
+    queued_cost_ -= queued.cost;
+  }
+  clients_.erase(found);
+}
+
+size_t scheduler::queued() const noexcept {
+  return queued_;
+}
+
+size_t scheduler::inflight() const noexcept {
+  return started_.size();
+}
+
+uint64_t scheduler::rejected() const noexcept {
+  return rejected_;
+}
+
+void scheduler::add_replaced(job replaced) {
+  // refresh requests are made by the server, client doesn't wait for them
+  if (replaced.head.refresh) {
+    return;
+  }
+
+  replaced.data.clear();
+  replaced_.emplace_back(std::move(replaced));
+}
+
+unsigned int scheduler::retry_after() const noexcept {
+  // time for handling of queued requests by started ones
+  double retval = queued_cost_ * ms_per_cost_ /
+                  std::max(started_.size(), size_t{1});
+  return static_cast<unsigned int>(
+      std::min(std::max(retval, double{MIN_RETRY_AFTER}),
+               double{MAX_RETRY_AFTER}));
+}
+} // namespace hl
+
+
+static int effective_priority(const hl::job &                  queued,
+                              const hl::job::clock::time_point &now) noexcept {
+  long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         now - queued.received)
+                         .count();
+
+  long long retval = queued.head.priority - waited / AGING_MS;
+  return retval > 0 ? static_cast<int>(retval) : 0;
+}
+
+static bool is_expired(const hl::job &                  queued,
+                       const hl::job::clock::time_point &now) noexcept {
+  if (queued.head.deadline_ms < 0) {
+    return false;
+  }
+
+  return now - queued.received >
+         std::chrono::milliseconds(queued.head.deadline_ms);
+}
+
+static size_t estimate_cost(const hl::request_head &head,
+                            const std::string &     data) noexcept {
+  return BASE_COST + head.flags_count * FLAG_COST + data.size();
+}
@@ -0,0 +1,142 @@
+#include "thread_pool.hpp"
+#include "c_logs/log.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace hl {
+thread_pool::thread_pool(size_t count, handler_type handler)
+    : count_{count}
+    , handler_{std::move(handler)}
+    , event_fd_{-1}
+    , busy_{0}
+    , stop_{false} {
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+
+  if (event_fd_ >= 0) {
+    close(event_fd_);
+  }
+}
+
+bool thread_pool::start() {
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd_ < 0) {
+    LOG_ERROR("can't create event descriptor: %s", strerror(errno));
+    return false;
+  }
+
+  threads_.reserve(count_);
+  for (size_t i = 0; i < count_; ++i) {
+    threads_.emplace_back(&thread_pool::run, this);
+  }
+
+  LOG_INFO("started threads: %zu", count_);
+  return count_ != 0;
+}
+
+bool thread_pool::ready(const std::string &) const {
+  return busy_ < count_;
+}
+
+bool thread_pool::send(uint64_t tag, const std::string &, std::string request) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    tasks_.emplace_back(task{tag, std::move(request)});
+  }
+  cv_.notify_one();
+
+  ++busy_;
+  return true;
+}
+
+void thread_pool::add_pollfds(std::vector<pollfd> &pfds) const {
+  pollfd pfd;
+  pfd.fd      = event_fd_;
+  pfd.events  = POLLIN;
+  pfd.revents = 0;
+  pfds.push_back(pfd);
+}
+
+size_t thread_pool::pollfds_count() const noexcept {
+  return 1;
+}
+
+std::list<executor::completion>
+thread_pool::handle_events(const pollfd *pfds) {
+  std::list<completion> retval;
+  if ((pfds[0].revents & POLLIN) == 0) {
+    return retval;
+  }
+
+  eventfd_t value;
+  eventfd_read(event_fd_, &value);
+
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    retval.swap(completions_);
+  }
+
+  for (const completion &done : retval) {
+    if (done.partial == false) {
+      --busy_;
+    }
+  }
+  return retval;
+}
+
+void thread_pool::reload() {
+}
+
+void thread_pool::run() {
+  for (;;) {
+    task current;
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait(lock, [this]() {
+        return stop_ || tasks_.empty() == false;
+      });
+      if (stop_) {
+        return;
+      }
+
+      current = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    uint64_t     tag     = current.tag;
+    partial_type partial = [this, tag](std::string response) {
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        completions_.emplace_back(
+            completion{tag, false, true, std::move(response), {}});
+      }
+      eventfd_write(event_fd_, 1);
+    };
+
+    dependencies deps;
+    std::string  response = handler_(current.request.c_str(), partial, deps);
+
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      completions_.emplace_back(completion{current.tag,
+                                           false,
+                                           false,
+                                           std::move(response),
+                                           std::move(deps)});
+    }
+    eventfd_write(event_fd_, 1);
+  }
+}
+} // namespace hl
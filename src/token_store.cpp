@@ -0,0 +1,431 @@
+#include "token_store.hpp"
+#include "c_logs/log.h"
+#include "hash.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define FILE_MAGIC       "HLSTORE2"
+#define FILE_HEADER_SIZE 8
+#define RECORD_MAGIC     0x52544c48 // HLTR
+#define TMP_SUFFIX       ".tmp"
+
+// XXX body of record is stamps of headers, then tokens
+struct record_header {
+  uint32_t magic;
+  uint32_t size; // of body after the header
+  uint64_t key;
+  uint64_t checksum; // of body
+  uint32_t stamps_size;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(record_header) == 32, "record header must be packed");
+
+static bool     read_all(int fd, char *data, size_t size, size_t offset);
+static bool     write_all(int fd, const char *data, size_t size, size_t offset);
+static uint64_t checksum(const char *data, size_t size) noexcept;
+
+namespace hl {
+token_store::token_store(std::string path, size_t max_size)
+    : path_{std::move(path)}
+    , max_size_{max_size}
+    , fd_{-1}
+    , data_{nullptr}
+    , mapped_{0}
+    , size_{0}
+    , use_counter_{0}
+    , loaded_{false}
+    , compacting_{false} {
+}
+
+token_store::~token_store() {
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+  if (compactor_.joinable()) {
+    compactor_.join();
+  }
+
+  if (data_ != nullptr) {
+    munmap(data_, mapped_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool token_store::open() {
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    LOG_ERROR("can't open tokens store %s: %s", path_.c_str(), strerror(errno));
+    return false;
+  }
+
+  // index is loaded in background, so the server starts immediately
+  loader_ = std::thread(&token_store::load, this);
+  return true;
+}
+
+bool token_store::get(uint64_t       key,
+                      std::string &  tokens,
+                      header_stamps &stamps) {
+  if (loaded_ == false) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  auto found = index_.find(key);
+  if (found == index_.end()) {
+    return false;
+  }
+
+  entry &record = found->second;
+  size_t end    = record.offset + sizeof(record_header) + record.size;
+  if (end > mapped_ && this->remap(size_) == false) {
+    return false;
+  }
+
+  record_header header;
+  memcpy(&header, data_ + record.offset, sizeof(header));
+  const char *body = data_ + record.offset + sizeof(header);
+  if (header.magic != RECORD_MAGIC || header.key != key ||
+      header.size != record.size || header.stamps_size > record.size ||
+      header.checksum != checksum(body, record.size) ||
+      read_stamps(body, header.stamps_size, stamps) == false) {
+    LOG_WARNING("broken record in tokens store %s", path_.c_str());
+    index_.erase(found);
+    return false;
+  }
+
+  record.used = ++use_counter_;
+  tokens.assign(body + header.stamps_size, record.size - header.stamps_size);
+  return true;
+}
+
+void token_store::put(uint64_t             key,
+                      const std::string &  tokens,
+                      const header_stamps &stamps) {
+  if (loaded_ == false) {
+    return;
+  }
+
+  std::string record(sizeof(record_header), '\0');
+  write_stamps(stamps, record);
+  size_t stamps_size = record.size() - sizeof(record_header);
+  size_t body_size   = stamps_size + tokens.size();
+  if (body_size > max_size_ / 2 || body_size > UINT32_MAX) {
+    return;
+  }
+  record += tokens;
+
+  record_header header{RECORD_MAGIC,
+                       static_cast<uint32_t>(body_size),
+                       key,
+                       checksum(&record[sizeof(record_header)], body_size),
+                       static_cast<uint32_t>(stamps_size),
+                       0};
+  memcpy(&record[0], &header, sizeof(header));
+
+  // XXX newer record replaces older one, also after loading, so tokens can be
+  // updated after changing of headers
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (write_all(fd_, record.data(), record.size(), size_) == false) {
+    LOG_ERROR("can't write to tokens store %s: %s",
+              path_.c_str(),
+              strerror(errno));
+
+    // not completely written record must not be loaded after restart
+    if (ftruncate(fd_, size_) != 0) {
+      LOG_ERROR("can't truncate tokens store %s", path_.c_str());
+    }
+    return;
+  }
+
+  index_[key] = entry{size_, header.size, ++use_counter_};
+  size_ += record.size();
+
+  if (size_ > max_size_ && compacting_ == false) {
+    compacting_ = true;
+
+    // previous compaction is already finished
+    if (compactor_.joinable()) {
+      compactor_.join();
+    }
+    compactor_ = std::thread(&token_store::compact, this);
+  }
+}
+
+void token_store::load() {
+  struct stat st;
+  size_t      size   = 0;
+  size_t      offset = FILE_HEADER_SIZE;
+  char        magic[FILE_HEADER_SIZE];
+  char *      data   = nullptr;
+  index_type  index;
+  uint64_t    used = 0;
+
+  if (fstat(fd_, &st) != 0) {
+    LOG_ERROR("can't get size of tokens store %s: %s",
+              path_.c_str(),
+              strerror(errno));
+    return;
+  }
+  size = st.st_size;
+
+  if (size < FILE_HEADER_SIZE ||
+      read_all(fd_, magic, FILE_HEADER_SIZE, 0) == false ||
+      memcmp(magic, FILE_MAGIC, FILE_HEADER_SIZE) != 0) {
+    if (size != 0) {
+      LOG_WARNING("unknown format of tokens store %s, clear it",
+                  path_.c_str());
+    }
+
+    if (ftruncate(fd_, 0) != 0 ||
+        write_all(fd_, FILE_MAGIC, FILE_HEADER_SIZE, 0) == false) {
+      LOG_ERROR("can't initialize tokens store %s: %s",
+                path_.c_str(),
+                strerror(errno));
+      return;
+    }
+    size = FILE_HEADER_SIZE;
+  }
+
+  if (size > FILE_HEADER_SIZE) {
+    data = static_cast<char *>(
+        mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0));
+    if (data == MAP_FAILED) {
+      LOG_ERROR("can't map tokens store %s: %s",
+                path_.c_str(),
+                strerror(errno));
+      return;
+    }
+  }
+
+  // every record is checked, so broken tail is not used
+  while (offset + sizeof(record_header) <= size) {
+    record_header header;
+    memcpy(&header, data + offset, sizeof(header));
+
+    const char *body = data + offset + sizeof(header);
+    if (header.magic != RECORD_MAGIC ||
+        header.size > size - offset - sizeof(header) ||
+        header.stamps_size > header.size ||
+        header.checksum != checksum(body, header.size)) {
+      break;
+    }
+
+    index[header.key] = entry{offset, header.size, ++used};
+    offset += sizeof(header) + header.size;
+  }
+
+  if (offset != size) {
+    LOG_WARNING("tokens store %s is broken after %zu bytes, truncate it",
+                path_.c_str(),
+                offset);
+    if (ftruncate(fd_, offset) != 0) {
+      LOG_ERROR("can't truncate tokens store %s", path_.c_str());
+      if (data != nullptr) {
+        munmap(data, size);
+      }
+      return;
+    }
+  }
+
+  LOG_INFO("tokens store %s loaded: %zu records, %.1fMb",
+           path_.c_str(),
+           index.size(),
+           offset / 1024. / 1024.);
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  data_        = data;
+  mapped_      = data ? size : 0;
+  size_        = offset;
+  use_counter_ = used;
+  index_.swap(index);
+  loaded_ = true;
+}
+
+void token_store::compact() {
+  std::vector<std::pair<uint64_t, entry>> entries;
+  size_t                                  snapshot_end = 0;
+  std::string                             tmp_path     = path_ + TMP_SUFFIX;
+  int                                     tmp          = -1;
+  size_t                                  offset       = FILE_HEADER_SIZE;
+  index_type                              index;
+  std::string                             record;
+
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    entries.assign(index_.begin(), index_.end());
+    snapshot_end = size_;
+  }
+
+  LOG_INFO("compact tokens store %s: %.1fMb",
+           path_.c_str(),
+           snapshot_end / 1024. / 1024.);
+
+  // the most recently used records are kept
+  std::sort(entries.begin(),
+            entries.end(),
+            [](const std::pair<uint64_t, entry> &lhs,
+               const std::pair<uint64_t, entry> &rhs) {
+              return lhs.second.used > rhs.second.used;
+            });
+
+  tmp = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (tmp < 0 || write_all(tmp, FILE_MAGIC, FILE_HEADER_SIZE, 0) == false) {
+    LOG_ERROR("can't create file for compaction %s: %s",
+              tmp_path.c_str(),
+              strerror(errno));
+    goto Failure;
+  }
+
+  // XXX records are not changed after writing, so they can be read without
+  // lock
+  for (const std::pair<uint64_t, entry> &item : entries) {
+    size_t record_size = sizeof(record_header) + item.second.size;
+    if (offset + record_size > max_size_ / 2) {
+      continue;
+    }
+
+    record.resize(record_size);
+    if (read_all(fd_, &record[0], record_size, item.second.offset) == false ||
+        write_all(tmp, record.data(), record_size, offset) == false) {
+      LOG_ERROR("can't copy record to %s: %s",
+                tmp_path.c_str(),
+                strerror(errno));
+      goto Failure;
+    }
+
+    index[item.first] = entry{offset, item.second.size, item.second.used};
+    offset += record_size;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    // records, which were added during compaction
+    for (const auto &item : index_) {
+      if (item.second.offset < snapshot_end) {
+        continue;
+      }
+
+      size_t record_size = sizeof(record_header) + item.second.size;
+      record.resize(record_size);
+      if (read_all(fd_, &record[0], record_size, item.second.offset) ==
+              false ||
+          write_all(tmp, record.data(), record_size, offset) == false) {
+        LOG_ERROR("can't copy record to %s: %s",
+                  tmp_path.c_str(),
+                  strerror(errno));
+        goto Failure;
+      }
+
+      index[item.first] = entry{offset, item.second.size, item.second.used};
+      offset += record_size;
+    }
+
+    if (fsync(tmp) != 0 || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+      LOG_ERROR("can't replace tokens store %s: %s",
+                path_.c_str(),
+                strerror(errno));
+      goto Failure;
+    }
+
+    if (data_ != nullptr) {
+      munmap(data_, mapped_);
+    }
+    close(fd_);
+
+    fd_     = tmp;
+    data_   = nullptr;
+    mapped_ = 0;
+    size_   = offset;
+    index_.swap(index);
+    this->remap(size_);
+
+    LOG_INFO("tokens store %s compacted: %zu records, %.1fMb",
+             path_.c_str(),
+             index_.size(),
+             size_ / 1024. / 1024.);
+
+    compacting_ = false;
+  }
+  return;
+
+Failure:
+  if (tmp >= 0) {
+    close(tmp);
+    unlink(tmp_path.c_str());
+  }
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  compacting_ = false;
+}
+
+bool token_store::remap(size_t size) {
+  if (size <= mapped_) {
+    return true;
+  }
+
+  void *data = data_ == nullptr
+                   ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0)
+                   : mremap(data_, mapped_, size, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    LOG_ERROR("can't map tokens store %s: %s", path_.c_str(), strerror(errno));
+    return false;
+  }
+
+  data_   = static_cast<char *>(data);
+  mapped_ = size;
+  return true;
+}
+} // namespace hl
+
+
+static bool read_all(int fd, char *data, size_t size, size_t offset) {
+  while (size != 0) {
+    ssize_t count = pread(fd, data, size, offset);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return false;
+    }
+
+    data += count;
+    size -= count;
+    offset += count;
+  }
+
+  return true;
+}
+
+static bool write_all(int fd, const char *data, size_t size, size_t offset) {
+  while (size != 0) {
+    ssize_t count = pwrite(fd, data, size, offset);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      return false;
+    }
+
+    data += count;
+    size -= count;
+    offset += count;
+  }
+
+  return true;
+}
+
+static uint64_t checksum(const char *data, size_t size) noexcept {
+  hl::hasher hasher;
+  hasher.update(data, size);
+  return hasher.digest();
+}
@@ -0,0 +1,281 @@
+#include "trace.hpp"
+#include "c_logs/log.h"
+#include "hash.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#define FLUSH_INTERVAL_MS 100
+#define FLUSH_SIZE        64 * 1024        // 64Kb, written without waiting
+#define MAX_BUFFER_SIZE   16 * 1024 * 1024 // 16Mb, newer events are dropped
+
+namespace {
+struct writer_state {
+  std::mutex              mutex;
+  std::condition_variable cv;
+  std::string             buffer;
+  bool                    stopping = false;
+  uint64_t                dropped  = 0;
+  std::thread             thread;
+};
+} // namespace
+
+static std::unique_ptr<writer_state> writer;
+static std::atomic<bool>             started{false};
+static int                           trace_fd    = -1;
+static unsigned int                  sample_rate = 1;
+
+static thread_local hl::trace::request_scope *current_request = nullptr;
+
+static void run_writer(writer_state *state) noexcept;
+static bool write_all(const char *data, size_t size) noexcept;
+static long long to_us(hl::trace::clock::time_point point) noexcept;
+static long      thread_id() noexcept;
+
+namespace hl {
+namespace trace {
+bool start(const char *path, unsigned int rate) {
+  trace_fd =
+      open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (trace_fd < 0) {
+    LOG_ERROR("can't open trace file %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  if (write_all("[\n", 2) == false) {
+    close(trace_fd);
+    trace_fd = -1;
+    return false;
+  }
+
+  sample_rate = rate == 0 ? 1 : rate;
+  writer.reset(new writer_state{});
+  try {
+    writer->thread = std::thread(run_writer, writer.get());
+  } catch (std::exception &e) {
+    LOG_ERROR("can't start trace writing thread: %s", e.what());
+    writer.reset();
+    close(trace_fd);
+    trace_fd = -1;
+    return false;
+  }
+
+  started = true;
+  return true;
+}
+
+void stop() {
+  if (started == false) {
+    return;
+  }
+
+  started = false;
+  {
+    std::lock_guard<std::mutex> lock{writer->mutex};
+    writer->stopping = true;
+  }
+  writer->cv.notify_one();
+  writer->thread.join();
+
+  if (writer->dropped != 0) {
+    LOG_WARNING("dropped trace events: %" PRIu64, writer->dropped);
+  }
+  writer.reset();
+
+  // metadata event closes json array
+  char end[128];
+  int  size = snprintf(end,
+                      sizeof(end),
+                      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                      "\"args\":{\"name\":\"hl-server\"}}\n]\n",
+                      getpid());
+  write_all(end, size);
+  close(trace_fd);
+  trace_fd = -1;
+}
+
+void reset_after_fork() {
+  if (started == false) {
+    return;
+  }
+
+  // XXX the thread of the supervisor doesn't exist in the worker, and its
+  // mutex can be locked, so the state is leaked instead of destruction.
+  // Events of the supervisor are not written twice
+  writer.release();
+  writer.reset(new writer_state{});
+  try {
+    writer->thread = std::thread(run_writer, writer.get());
+  } catch (std::exception &e) {
+    LOG_ERROR("can't start trace writing thread: %s", e.what());
+    started = false;
+  }
+}
+
+bool enabled() noexcept {
+  return started.load(std::memory_order_relaxed);
+}
+
+bool sampled(const std::string &id, int message_number) noexcept {
+  if (sample_rate == 1) {
+    return true;
+  }
+
+  hl::hasher hasher;
+  hasher.update(id.data(), id.size());
+  hasher.update(&message_number, sizeof(message_number));
+  return hasher.digest() % sample_rate == 0;
+}
+
+void complete(const char *      name,
+              clock::time_point begin,
+              clock::time_point end,
+              const tags &      request_tags) noexcept {
+  using nlohmann::json;
+
+  if (enabled() == false) {
+    return;
+  }
+
+  try {
+    char numbers[128];
+    snprintf(numbers,
+             sizeof(numbers),
+             "\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%ld",
+             to_us(begin),
+             to_us(end) - to_us(begin),
+             getpid(),
+             thread_id());
+
+    std::string event = "{\"name\":\"";
+    event += name;
+    event += "\",\"cat\":\"request\",\"ph\":\"X\",";
+    event += numbers;
+    event += ",\"args\":{";
+    if (request_tags.connection != 0) {
+      event += "\"connection\":" + std::to_string(request_tags.connection);
+      event += ',';
+    }
+    event += "\"id\":" + json(request_tags.id).dump();
+    event += ",\"buf_name\":" + json(request_tags.buf_name).dump();
+    event += ",\"message_number\":";
+    event += std::to_string(request_tags.message_number);
+    event += ",\"size\":" + std::to_string(request_tags.size);
+    if (request_tags.tokens != 0) {
+      event += ",\"tokens\":" + std::to_string(request_tags.tokens);
+    }
+    event += "}},\n";
+
+    std::lock_guard<std::mutex> lock{writer->mutex};
+    if (writer->buffer.size() + event.size() > MAX_BUFFER_SIZE) {
+      ++writer->dropped;
+      return;
+    }
+    writer->buffer += event;
+    if (writer->buffer.size() >= FLUSH_SIZE) {
+      writer->cv.notify_one();
+    }
+  } catch (std::exception &) {
+    // tracing must not break handling of request
+  }
+}
+
+void phase(const char *name, clock::time_point begin) noexcept {
+  if (current_request != nullptr && current_request->sampled_) {
+    complete(name, begin, clock::now(), current_request->tags_);
+  }
+}
+
+request_scope::request_scope() noexcept
+    : start_{clock::now()}
+    , tags_{}
+    , sampled_{false}
+    , previous_{current_request} {
+  current_request = this;
+}
+
+request_scope::~request_scope() {
+  if (sampled_) {
+    complete("process", start_, clock::now(), tags_);
+  }
+  current_request = previous_;
+}
+
+void request_scope::begin(tags request_tags) {
+  tags_    = std::move(request_tags);
+  sampled_ = enabled() && sampled(tags_.id, tags_.message_number);
+}
+
+void request_scope::set_size(size_t size) noexcept {
+  tags_.size = size;
+}
+
+void request_scope::set_tokens(size_t count) noexcept {
+  tags_.tokens = count;
+}
+} // namespace trace
+} // namespace hl
+
+
+static void run_writer(writer_state *state) noexcept {
+  std::unique_lock<std::mutex> lock{state->mutex};
+  for (;;) {
+    state->cv.wait_for(lock,
+                       std::chrono::milliseconds{FLUSH_INTERVAL_MS},
+                       [state]() {
+                         return state->stopping ||
+                                state->buffer.size() >= FLUSH_SIZE;
+                       });
+
+    std::string data;
+    data.swap(state->buffer);
+    bool stopping = state->stopping;
+
+    // the file is written without lock, so callers are not blocked
+    lock.unlock();
+    write_all(data.data(), data.size());
+    lock.lock();
+
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+static bool write_all(const char *data, size_t size) noexcept {
+  while (size != 0) {
+    ssize_t count = write(trace_fd, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      LOG_ERROR("can't write trace: %s", strerror(errno));
+      return false;
+    }
+
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+static long long to_us(hl::trace::clock::time_point point) noexcept {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             point.time_since_epoch())
+      .count();
+}
+
+static long thread_id() noexcept {
+  // XXX not cached, because thread local value is copied to forked worker
+  return syscall(SYS_gettid);
+}
@@ -0,0 +1,486 @@
+#include "worker_pool.hpp"
+#include "async_log.hpp"
+#include "c_logs/log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DELIMITER       '\n'
+#define TAG_DELIMITER   ' '
+#define PARTIAL_MARK    '+'       // instead of tag delimiter in partial response
+#define DEPS_MARK       '&'       // instead of tag delimiter in dependencies
+#define DEPS_DELIMITER  '\0'      // between request and files in dependencies
+#define CHUNK_SIZE      64 * 1024 // 64Kb
+#define VIRTUAL_NODES   64        // per worker in hash ring
+#define WORKER_QUEUE    2         // requests per worker at the same time
+
+
+[[noreturn]] static void run_worker(int                               fd,
+                                    const hl::executor::handler_type &handler);
+static bool     write_all(int fd, const char *data, size_t size) noexcept;
+static uint64_t hash(const char *data, size_t size) noexcept;
+static std::string
+write_deps(uint64_t tag, const hl::executor::dependencies &deps);
+static hl::executor::dependencies parse_deps(const char *begin,
+                                             const char *end);
+
+namespace hl {
+worker_pool::worker_pool(size_t                      count,
+                         handler_type                handler,
+                         std::function<void(size_t)> on_fork)
+    : handler_{std::move(handler)}
+    , on_fork_{std::move(on_fork)}
+    , workers_(count, worker{-1, -1, "", "", 0, {}, {}}) {
+  ring_.reserve(count * VIRTUAL_NODES);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < VIRTUAL_NODES; ++j) {
+      std::string node = std::to_string(i) + '#' + std::to_string(j);
+      ring_.emplace_back(hash(node.c_str(), node.size()), i);
+    }
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+worker_pool::~worker_pool() {
+  // workers finish after getting EOF
+  for (worker &w : workers_) {
+    if (w.fd >= 0) {
+      close(w.fd);
+    }
+  }
+
+  for (worker &w : workers_) {
+    if (w.pid > 0) {
+      waitpid(w.pid, nullptr, 0);
+    }
+  }
+}
+
+bool worker_pool::start() {
+  size_t started = 0;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (this->spawn(i)) {
+      ++started;
+    }
+  }
+
+  LOG_INFO("started workers: %zu/%zu", started, workers_.size());
+  return started != 0;
+}
+
+bool worker_pool::ready(const std::string &route_key) const {
+  return workers_[this->route(route_key)].inflight.size() < WORKER_QUEUE;
+}
+
+bool worker_pool::send(uint64_t           tag,
+                       const std::string &route_key,
+                       std::string        request) {
+  size_t  index = this->route(route_key);
+  worker &w     = workers_[index];
+
+  if (w.fd < 0 && this->spawn(index) == false) {
+    return false;
+  }
+
+  w.output += std::to_string(tag);
+  w.output += TAG_DELIMITER;
+  w.output += request;
+  w.output += DELIMITER;
+  w.inflight.emplace_back(pending{tag, std::move(request)});
+
+  ALOG_DEBUG("request %" PRIu64 " routed to worker %d", tag, w.pid);
+
+  this->flush(w);
+  return true;
+}
+
+void worker_pool::add_pollfds(std::vector<pollfd> &pfds) const {
+  for (const worker &w : workers_) {
+    pollfd pfd;
+    pfd.fd      = w.fd; // negative descriptors are ignored by poll
+    pfd.events  = POLLIN | POLLRDHUP | POLLHUP | POLLERR;
+    pfd.revents = 0;
+    if (w.output.size() != w.output_offset) {
+      pfd.events |= POLLOUT;
+    }
+    pfds.push_back(pfd);
+  }
+}
+
+std::list<executor::completion>
+worker_pool::handle_events(const pollfd *pfds) {
+  std::list<completion> completions;
+  char                  chunk[CHUNK_SIZE];
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    worker &w       = workers_[i];
+    short   revents = pfds[i].revents;
+    bool    broken  = false;
+
+    if (revents == 0 || w.fd < 0) {
+      continue;
+    }
+
+    if (revents & POLLOUT) {
+      this->flush(w);
+    }
+
+    if (revents & (POLLIN | POLLRDHUP | POLLHUP | POLLERR)) {
+      // read all available data, responses can be received before EOF
+      for (;;) {
+        ssize_t count = recv(w.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (count > 0) {
+          w.input.append(chunk, count);
+          continue;
+        } else if (count < 0 && errno == EINTR) {
+          continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          break;
+        }
+
+        broken = true;
+        break;
+      }
+
+      size_t start = 0;
+      size_t found = std::string::npos;
+      while ((found = w.input.find(DELIMITER, start)) != std::string::npos) {
+        char *   response = nullptr;
+        uint64_t tag = strtoull(w.input.c_str() + start, &response, 10);
+        bool     partial  = *response == PARTIAL_MARK;
+        bool     deps     = *response == DEPS_MARK;
+        if (*response == TAG_DELIMITER || partial || deps) {
+          ++response;
+        }
+
+        // dependencies are sent right before final response
+        if (deps) {
+          w.deps = parse_deps(response, &w.input[found]);
+          start  = found + 1;
+          continue;
+        }
+
+        // worker handles requests in order
+        if (w.inflight.empty() || w.inflight.front().tag != tag) {
+          LOG_ERROR("unexpected response from worker %d", w.pid);
+        } else if (partial == false) {
+          w.inflight.pop_front();
+        }
+
+        completions.emplace_back(completion{
+            tag,
+            false,
+            partial,
+            std::string(response, &w.input[found]),
+            partial ? dependencies{} : std::move(w.deps)});
+        if (partial == false) {
+          w.deps = dependencies{};
+        }
+        start = found + 1;
+      }
+      w.input.erase(0, start);
+    }
+
+    if (broken) {
+      this->reap(i, completions);
+    }
+  }
+
+  return completions;
+}
+
+size_t worker_pool::pollfds_count() const noexcept {
+  return workers_.size();
+}
+
+void worker_pool::reload() {
+  for (const worker &w : workers_) {
+    if (w.pid > 0 && kill(w.pid, SIGHUP) != 0) {
+      LOG_WARNING("can't notify worker %d: %s", w.pid, strerror(errno));
+    }
+  }
+}
+
+bool worker_pool::spawn(size_t index) {
+  worker &w = workers_[index];
+  int     fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    LOG_ERROR("can't create channel for worker: %s", strerror(errno));
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    LOG_ERROR("can't fork worker: %s", strerror(errno));
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  } else if (pid == 0) {
+    close(fds[0]);
+    for (worker &other : workers_) {
+      if (other.fd >= 0) {
+        close(other.fd);
+      }
+    }
+    if (on_fork_) {
+      on_fork_(index);
+    }
+
+    // stop by closing the channel, not by terminal interrupt
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+
+    run_worker(fds[1], handler_);
+  }
+
+  close(fds[1]);
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+  w.pid           = pid;
+  w.fd            = fds[0];
+  w.output_offset = 0;
+  w.input.clear();
+  w.output.clear();
+
+  LOG_DEBUG("worker %d started", pid);
+  return true;
+}
+
+void worker_pool::reap(size_t index, std::list<completion> &completions) {
+  worker &w      = workers_[index];
+  int     status = 0;
+
+  close(w.fd);
+  w.fd   = -1;
+  w.deps = dependencies{};
+
+  if (waitpid(w.pid, &status, 0) < 0) {
+    LOG_ERROR("can't wait worker %d: %s", w.pid, strerror(errno));
+  } else if (WIFSIGNALED(status)) {
+    LOG_ERROR("worker %d killed by signal %d", w.pid, WTERMSIG(status));
+  } else {
+    LOG_WARNING("worker %d exited with code %d", w.pid, WEXITSTATUS(status));
+  }
+  w.pid = -1;
+
+  // the first request was in work during crash, so don't repeat it
+  if (w.inflight.empty() == false) {
+    completions.emplace_back(
+        completion{w.inflight.front().tag,
+                   true,
+                   false,
+                   w.inflight.front().request,
+                   {}});
+    w.inflight.pop_front();
+  }
+
+  if (this->spawn(index) == false) {
+    for (pending &request : w.inflight) {
+      completions.emplace_back(completion{request.tag,
+                                          true,
+                                          false,
+                                          std::move(request.request),
+                                          {}});
+    }
+    w.inflight.clear();
+    return;
+  }
+
+  for (const pending &request : w.inflight) {
+    w.output += std::to_string(request.tag);
+    w.output += TAG_DELIMITER;
+    w.output += request.request;
+    w.output += DELIMITER;
+  }
+  if (w.inflight.empty() == false) {
+    LOG_INFO("resend %zu requests to restarted worker %d",
+             w.inflight.size(),
+             w.pid);
+    this->flush(w);
+  }
+}
+
+void worker_pool::flush(worker &w) {
+  while (w.fd >= 0 && w.output_offset < w.output.size()) {
+    ssize_t count = ::send(w.fd,
+                           w.output.c_str() + w.output_offset,
+                           w.output.size() - w.output_offset,
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // broken channel will be handled by poll
+        LOG_ERROR("can't write to worker %d: %s", w.pid, strerror(errno));
+      }
+      return;
+    }
+
+    w.output_offset += count;
+  }
+
+  w.output.clear();
+  w.output_offset = 0;
+}
+
+size_t worker_pool::route(const std::string &route_key) const noexcept {
+  uint64_t key_hash = hash(route_key.c_str(), route_key.size());
+
+  auto found = std::lower_bound(ring_.begin(),
+                                ring_.end(),
+                                std::make_pair(key_hash, size_t{0}));
+  if (found == ring_.end()) {
+    found = ring_.begin();
+  }
+
+  return found->second;
+}
+} // namespace hl
+
+
+static void run_worker(int fd, const hl::executor::handler_type &handler) {
+  std::string input;
+  size_t      scanned = 0;
+  char        chunk[CHUNK_SIZE];
+
+  for (;;) {
+    ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      LOG_ERROR("worker reading error: %s", strerror(errno));
+      break;
+    } else if (count == 0) {
+      break;
+    }
+
+    input.append(chunk, count);
+
+    size_t start = 0;
+    size_t found = std::string::npos;
+    while ((found = input.find(DELIMITER, std::max(start, scanned))) !=
+           std::string::npos) {
+      input[found]   = '\0';
+      char *   data  = nullptr;
+      uint64_t tag   = strtoull(input.c_str() + start, &data, 10);
+      if (*data == TAG_DELIMITER) {
+        ++data;
+      }
+
+      hl::executor::partial_type partial = [fd, tag](std::string response) {
+        std::string frame = std::to_string(tag);
+        frame += PARTIAL_MARK;
+        frame += response;
+        frame += DELIMITER;
+
+        if (write_all(fd, frame.c_str(), frame.size()) == false) {
+          LOG_ERROR("worker writing error: %s", strerror(errno));
+          _exit(EXIT_FAILURE);
+        }
+      };
+
+      hl::executor::dependencies deps;
+      std::string                response = handler(data, partial, deps);
+
+      // dependencies are sent before final response
+      std::string frame = write_deps(tag, deps);
+      frame += std::to_string(tag);
+      frame += TAG_DELIMITER;
+      frame += response;
+      frame += DELIMITER;
+      response.swap(frame);
+
+      if (write_all(fd, response.c_str(), response.size()) == false) {
+        LOG_ERROR("worker writing error: %s", strerror(errno));
+        _exit(EXIT_FAILURE);
+      }
+
+      start = found + 1;
+    }
+
+    input.erase(0, start);
+    scanned = input.size();
+  }
+
+  close(fd);
+  _exit(EXIT_SUCCESS);
+}
+
+static bool write_all(int fd, const char *data, size_t size) noexcept {
+  while (size != 0) {
+    ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      return false;
+    }
+
+    data += count;
+    size -= count;
+  }
+
+  return true;
+}
+
+static std::string
+write_deps(uint64_t tag, const hl::executor::dependencies &deps) {
+  std::string frame;
+  if (deps.files.empty()) {
+    return frame;
+  }
+
+  frame += std::to_string(tag);
+  frame += DEPS_MARK;
+  frame += deps.refresh_request;
+  for (const std::string &file : deps.files) {
+    // XXX such paths can't be framed, they are not watched
+    if (file.find(DELIMITER) != std::string::npos) {
+      continue;
+    }
+
+    frame += DEPS_DELIMITER;
+    frame += file;
+  }
+  frame += DELIMITER;
+
+  return frame;
+}
+
+static hl::executor::dependencies parse_deps(const char *begin,
+                                             const char *end) {
+  hl::executor::dependencies deps;
+
+  const char *found = std::find(begin, end, DEPS_DELIMITER);
+  deps.refresh_request.assign(begin, found);
+  while (found != end) {
+    begin = found + 1;
+    found = std::find(begin, end, DEPS_DELIMITER);
+    deps.files.emplace_back(begin, found);
+  }
+
+  return deps;
+}
+
+static uint64_t hash(const char *data, size_t size) noexcept {
+  // FNV-1a with splitmix finalizer for better distribution on the ring
+  uint64_t retval = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    retval ^= static_cast<unsigned char>(data[i]);
+    retval *= 1099511628211ull;
+  }
+
+  retval ^= retval >> 30;
+  retval *= 0xbf58476d1ce4e5b9ull;
+  retval ^= retval >> 27;
+  retval *= 0x94d049bb133111ebull;
+  retval ^= retval >> 31;
+  return retval;
+}
@@ -0,0 +1,305 @@
+// benchmark of serialization of responses, compares writer of v1.1 response
+// with json document, which was used before it, and v1.1 tokens with delta
+// encoded tokens (size, writing and decoding by client)
+//
+// usage: hl-bench [--lexical] [--repeat=N] FILE [FLAGS...]
+
+#include "arena.hpp"
+#include "clang_tokenize.hpp"
+#include "lexical_tokenize.hpp"
+#include "response_writer.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <chrono>
+#include <clang-c/Index.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#define DEFAULT_REPEAT   20
+#define ARENA_BLOCK_SIZE 256 * 1024
+
+#define VERSION_TAG       "version"
+#define ID_TAG            "id"
+#define BUF_TYPE_TAG      "buf_type"
+#define BUF_NAME_TAG      "buf_name"
+#define RETURN_CODE_TAG   "return_code"
+#define ERROR_MESSAGE_TAG "error_message"
+#define TOKENS_TAG        "tokens"
+
+using bench_clock = std::chrono::steady_clock;
+
+// row, column, length, group
+using decoded_token =
+    std::tuple<unsigned int, unsigned int, unsigned int, std::string>;
+
+static std::string dom_response(const hl::token_list &tokens,
+                                const std::string &   buf_name);
+static bool        is_sorted(const hl::token_list &tokens) noexcept;
+static void        decode_v11(const std::string &         serialized,
+                              std::vector<decoded_token> &out);
+static void        decode_delta(const std::string &         serialized,
+                                std::vector<decoded_token> &out);
+static double      ms_since(bench_clock::time_point start) noexcept;
+
+int main(int argc, char *argv[]) {
+  bool                      lexical = false;
+  int                       repeat  = DEFAULT_REPEAT;
+  const char *              path    = nullptr;
+  std::vector<const char *> flags;
+
+  for (int i = 1; i < argc; ++i) {
+    if (path != nullptr) {
+      flags.push_back(argv[i]);
+    } else if (strcmp(argv[i], "--lexical") == 0) {
+      lexical = true;
+    } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = atoi(argv[i] + 9);
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr || repeat <= 0) {
+    fprintf(stderr,
+            "usage: %s [--lexical] [--repeat=N] FILE [FLAGS...]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::ifstream file{path, std::ios::binary};
+  std::string   body{std::istreambuf_iterator<char>{file},
+                   std::istreambuf_iterator<char>{}};
+  if (file.is_open() == false) {
+    fprintf(stderr, "can't read %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  hl::arena       bench_arena{ARENA_BLOCK_SIZE};
+  hl::arena_scope scope{bench_arena};
+
+  std::string    err;
+  hl::token_list tokens;
+  if (lexical) {
+    tokens = hl::lexical_tokenize(body.data(), body.size());
+  } else {
+    tokens = hl::clang_tokenize(path,
+                                flags.size(),
+                                flags.data(),
+                                CXTranslationUnit_DetailedPreprocessingRecord,
+                                nullptr,
+                                err);
+  }
+  if (err.empty() == false) {
+    fprintf(stderr, "can't tokenize %s: %s\n", path, err.c_str());
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %zu tokens by %s, %zu repeats\n",
+         path,
+         tokens.size(),
+         lexical ? "lexer" : "libclang",
+         size_t(repeat));
+
+  // json document, built and dumped
+  std::string             expected;
+  bench_clock::time_point start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    expected = dom_response(tokens, path);
+  }
+  double dom_ms = ms_since(start) / repeat;
+
+  // writer with new buffers for every response
+  std::string actual;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    std::string serialized;
+    hl::write_tokens(tokens, serialized);
+
+    actual.clear();
+    actual.shrink_to_fit();
+    hl::write_response(
+        0, "v1.1", "", "cpp", path, 0, "", false, false, serialized, actual);
+  }
+  double writer_ms = ms_since(start) / repeat;
+
+  // writer with buffer of tokens, which is kept between responses
+  std::string serialized;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    serialized.clear();
+    hl::write_tokens(tokens, serialized);
+
+    std::string response;
+    hl::write_response(0,
+                       "v1.1",
+                       "",
+                       "cpp",
+                       path,
+                       0,
+                       "",
+                       false,
+                       false,
+                       serialized,
+                       response);
+  }
+  double reused_ms = ms_since(start) / repeat;
+
+  printf("v1.1 response: %zu bytes, %.1f bytes per token, %s\n",
+         actual.size(),
+         double(actual.size()) / std::max<size_t>(tokens.size(), 1),
+         actual == expected ? "the same as json dump" : "DIFFERS FROM DUMP");
+  printf("  json document:       %8.3f ms\n", dom_ms);
+  printf("  writer:              %8.3f ms\n", writer_ms);
+  printf("  writer, kept buffer: %8.3f ms\n", reused_ms);
+
+  // delta encoding, writing includes sorting of tokens by position
+  std::string delta;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    delta.clear();
+    hl::write_delta_tokens(tokens, delta);
+  }
+  double delta_ms = ms_since(start) / repeat;
+
+  // tokens grouped like in v1.1 object (for example from go tokenizer) must
+  // be sorted before writing
+  hl::token_list grouped = tokens;
+  grouped.sort([](const hl::token &lhs, const hl::token &rhs) {
+    return lhs.group < rhs.group;
+  });
+  std::string grouped_delta;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    grouped_delta.clear();
+    hl::write_delta_tokens(grouped, grouped_delta);
+  }
+  double grouped_ms = ms_since(start) / repeat;
+
+  // client parses tokens and gets positions with groups
+  std::vector<decoded_token> v11_tokens;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    decode_v11(serialized, v11_tokens);
+  }
+  double decode_v11_ms = ms_since(start) / repeat;
+
+  std::vector<decoded_token> delta_tokens;
+  start = bench_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    decode_delta(delta, delta_tokens);
+  }
+  double decode_delta_ms = ms_since(start) / repeat;
+
+  // the same tokens, but only delta encoded ones are sorted
+  std::sort(v11_tokens.begin(), v11_tokens.end());
+  bool same = v11_tokens.size() == delta_tokens.size() &&
+              std::is_sorted(delta_tokens.begin(), delta_tokens.end()) &&
+              std::equal(v11_tokens.begin(),
+                         v11_tokens.end(),
+                         delta_tokens.begin());
+
+  printf("tokens %s sorted by position\n",
+         is_sorted(tokens) ? "are" : "are not");
+  printf("v1.1 tokens:  %zu bytes, %.1f bytes per token\n",
+         serialized.size(),
+         double(serialized.size()) / std::max<size_t>(tokens.size(), 1));
+  printf("delta tokens: %zu bytes, %.1f bytes per token, %s\n",
+         delta.size(),
+         double(delta.size()) / std::max<size_t>(tokens.size(), 1),
+         same ? "the same tokens" : "DIFFERENT TOKENS");
+  printf("  write v1.1:    %8.3f ms\n", reused_ms);
+  printf("  write delta:   %8.3f ms\n", delta_ms);
+  printf("  write delta of grouped tokens: %.3f ms\n", grouped_ms);
+  printf("  decode v1.1:   %8.3f ms\n", decode_v11_ms);
+  printf("  decode delta:  %8.3f ms\n", decode_delta_ms);
+
+  // ties of positions can be ordered differently
+  std::vector<decoded_token> grouped_tokens;
+  decode_delta(grouped_delta, grouped_tokens);
+  std::sort(grouped_tokens.begin(), grouped_tokens.end());
+  same = same && grouped_tokens == v11_tokens;
+
+  return actual == expected && same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static std::string dom_response(const hl::token_list &tokens,
+                                const std::string &   buf_name) {
+  using nlohmann::json;
+
+  json jresponse;
+  jresponse[0]                    = 0;
+  jresponse[1][VERSION_TAG]       = "v1.1";
+  jresponse[1][ID_TAG]            = "";
+  jresponse[1][BUF_TYPE_TAG]      = "cpp";
+  jresponse[1][BUF_NAME_TAG]      = buf_name;
+  jresponse[1][RETURN_CODE_TAG]   = 0;
+  jresponse[1][ERROR_MESSAGE_TAG] = "";
+  jresponse[1][TOKENS_TAG]        = json::object();
+  for (const hl::token &tok : tokens) {
+    jresponse[1][TOKENS_TAG][std::string{tok.group.data(), tok.group.size()}]
+        .emplace_back(tok.pos);
+  }
+
+  return jresponse.dump();
+}
+
+static bool is_sorted(const hl::token_list &tokens) noexcept {
+  return std::is_sorted(tokens.begin(),
+                        tokens.end(),
+                        [](const hl::token &lhs, const hl::token &rhs) {
+                          return lhs.pos[0] < rhs.pos[0] ||
+                                 (lhs.pos[0] == rhs.pos[0] &&
+                                  lhs.pos[1] < rhs.pos[1]);
+                        });
+}
+
+static void decode_v11(const std::string &         serialized,
+                       std::vector<decoded_token> &out) {
+  using nlohmann::json;
+
+  out.clear();
+  json jtokens = json::parse(serialized);
+  for (auto group = jtokens.begin(); group != jtokens.end(); ++group) {
+    for (const json &jpos : group.value()) {
+      out.emplace_back(jpos[0].get<unsigned int>(),
+                       jpos[1].get<unsigned int>(),
+                       jpos[2].get<unsigned int>(),
+                       group.key());
+    }
+  }
+}
+
+static void decode_delta(const std::string &         serialized,
+                         std::vector<decoded_token> &out) {
+  using nlohmann::json;
+
+  out.clear();
+  json        jtokens = json::parse(serialized);
+  const json &data    = jtokens["data"];
+  const json &groups  = jtokens["groups"];
+
+  unsigned int row    = 0;
+  unsigned int column = 0;
+  for (size_t i = 0; i + 3 < data.size(); i += 4) {
+    unsigned int delta_row = data[i].get<unsigned int>();
+    row += delta_row;
+    column = delta_row != 0 ? data[i + 1].get<unsigned int>()
+                            : column + data[i + 1].get<unsigned int>();
+    out.emplace_back(row,
+                     column,
+                     data[i + 2].get<unsigned int>(),
+                     groups[data[i + 3].get<size_t>()].get<std::string>());
+  }
+}
+
+static double ms_since(bench_clock::time_point start) noexcept {
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start)
+      .count();
+}